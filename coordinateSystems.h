@@ -30,10 +30,32 @@
 //image plane coordinate system(IPCS)
 //formula a point from RCS to IPCS
 //Pi = Mic * Pr
-//Mic downgrade to pinhole transform
-Point RCS2IPCS(const Point3D& Pr)
+//Mic = pinhole * Ry(-pitch) * T(0, 0, -height): move origin up to camera,
+//tilt by camera pitch (down is positive), then project.
+//RCS: X forward along the road, Y to the left, Z up, origin on the road
+//surface right under the camera.
+inline Point RCS2IPCS(const Point3D& Pr)
 {
-   return pinholeTransformer::translation(Focal, Fx, Fx, principleX, principleY, Pr);
+   HomoPoint3D Pc = eulerTransformer::rotation(0.0, -CAMERA_PITCH, 0.0,
+                       eulerTransformer::translation(Point3D(0.0, 0.0, -CAMERA_HEIGHT), Pr));
+   return pinholeTransformer::translation(Focal, Fx, Fy, principleX, principleY, Pc);
+}
+
+//inverse of RCS2IPCS for points on the road surface (Z = 0): cast the
+//pixel's ray from the camera and intersect it with the road plane.
+//Returns false when the ray never reaches the road, at or above horizon.
+inline bool IPCS2RCS(const Point& Pi, Point3D& Pr)
+{
+   //ray direction in camera coordinates, inverse of the pinhole model
+   HomoPoint3D ray(1.0, -(Pi.getX() - principleX)/(Focal*Fx), -(Pi.getY() - principleY)/(Focal*Fy));
+   //undo the camera pitch
+   HomoPoint3D Dr = eulerTransformer::rotation(0.0, CAMERA_PITCH, 0.0, ray);
+   if (Dr.getZ() >= 0.0)
+     return false;
+
+   float t = CAMERA_HEIGHT / -Dr.getZ();
+   Pr = Point3D(t*Dr.getX(), t*Dr.getY(), 0.0);
+   return true;
 }
 
 #endif  //COORDINATE_SYSTEMS_H
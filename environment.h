@@ -17,6 +17,7 @@
 #define NAVPRO_ENVIRONMENT_H_
 
 #include <math.h>
+#include <iostream>
 #include <QtGlobal>
 
 //default frame size is 640x480
@@ -67,12 +68,45 @@
 //focal length
 #define Focal 1.00
 
-//scaling factors in X and Y directions
-#define Fx 5.5
-#define Fy 5.5
+//scaling factors in X and Y directions, pixels per focal length unit,
+//about 55 degrees horizontal field of view on FRAME_WIDTH
+#define Fx 600.0
+#define Fy 600.0
 
-//principle point of the camera
-#define principleX 172.00
-#define principleY 107.00
+//principle point of the camera, centre of FRAME_WIDTH x FRAME_HEIGHT
+#define principleX 320.00
+#define principleY 240.00
+
+//camera height above road surface in meters, pitch down in radians.
+//Zero pitch puts the horizon on the middle row, the top of ROAD_RECT.
+#define CAMERA_HEIGHT 1.20
+#define CAMERA_PITCH  0.00
+
+//seconds between two input images, for sources without their own clock
+#define FRAME_INTERVAL 0.10
+
+//size of frames in raw BGR24 (*.bgr) and I420 (*.yuv) camera dumps
+#define RAW_FRAME_WIDTH  FRAME_WIDTH
+#define RAW_FRAME_HEIGHT FRAME_HEIGHT
+
+//ego-motion log in input image dir, see inputManager::getEgoMotion()
+#define EGO_MOTION_FILE "egomotion.csv"
+
+//per-frame diagnostics are printed only when switched on at run time
+//(--verbose), release builds with _DISABLE_LOG_ drop them entirely but
+//still compile the stream, so its variables count as used
+inline bool& verboseLog()
+{
+    static bool on = false;
+    return on;
+}
+
+#ifdef _DISABLE_LOG_
+#define VERBOSE_ON false
+#else
+#define VERBOSE_ON verboseLog()
+#endif
+#define VERBOSE_LOG(STREAM) \
+        do { if (VERBOSE_ON) std::cout<<STREAM<<std::endl; } while (0)
 
 #endif  //NAVPRO_ENVIRONMENT_H_
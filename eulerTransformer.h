@@ -78,21 +78,30 @@ class eulerTransformer
 //         |  0      0      1 0 |
 //         |  0      0      0 1 |
 //
-//       |            cos(θ)cos(ψ)                    cos(θ)*-sin(ψ)                   sin(θ)     0 |   | x |
-//p{B} = | -sin(φ)*-sin(θ)cos(ψ)+cos(φ)sin(ψ)   -sin(φ)*-sin(θ)*-sin(ψ)+cos(φ)cos(ψ)     0        0 |   | y |
-//       | cos(φ)*-sin(θ)cos(ψ)+sin(φ)sin(ψ)    cos(φ)*-sin(θ)*-sin(ψ)+sin(φ)cos(ψ)  cos(φ)cos(θ) 1 | * | z |
-//       |                 0                                0                            0        1 |   | 1 |
+//p{B} = Rx(φ) * Ry(θ) * Rz(ψ) * p{A}, applied right to left
 //rx, ry,rz are rotation along the X, Y and Z respecitvely, range is [0, 2Pi]
     static HomoPoint3D rotation(const float rx, const float ry, const float rz, const HomoPoint3D& PA)
     {
-        return HomoPoint3D(cos(ry)*cos(rz)*PA.getX() + cos(ry)*(-sin(rz))*PA.getY() + sin(ry)*PA.getZ(),
-                           ((-sin(rx))*(-sin(ry))*cos(rz)+cos(rx)*sin(rz))*PA.getX() + ((-sin(rx))*(-sin(ry))*(-sin(rz))+cos(rx)*cos(rz))*PA.getY(),
-                           (cos(rx)*(-sin(ry))*cos(rz)+sin(rx)*sin(rz))*PA.getX() + (cos(rx)*(-sin(ry))*(-sin(rz))+sin(rx)*cos(rz))*PA.getY() + cos(rx)*cos(ry)*PA.getZ() + 1);
+        //Rz first
+        float x1 = cos(rz)*PA.getX() - sin(rz)*PA.getY();
+        float y1 = sin(rz)*PA.getX() + cos(rz)*PA.getY();
+        float z1 = PA.getZ();
+
+        //then Ry
+        float x2 = cos(ry)*x1 + sin(ry)*z1;
+        float y2 = y1;
+        float z2 = -sin(ry)*x1 + cos(ry)*z1;
+
+        //Rx last
+        return HomoPoint3D(x2,
+                           cos(rx)*y2 - sin(rx)*z2,
+                           sin(rx)*y2 + cos(rx)*z2);
     }
 
+    //rigid transform, rotate P{A} then shift it by T
     static HomoPoint3D translationRotation(const Point3D& T, const float rx, const float ry, const float rz, const HomoPoint3D& PA)
     {
-        return translation(T, PA) + rotation(rx, ry, rz, PA);
+        return translation(T, rotation(rx, ry, rz, PA));
     }
 };
 
@@ -0,0 +1,377 @@
+/*=============================================================================
+**                            MODULE SPECIFICATION
+===============================================================================
+**
+**  Title : Frame sources
+**
+**  Description : JPEG directory, video file and raw dump frame sources, see
+**                frameSource.h
+**
+**
+===============================================================================
+**  Author            :     Xin Zhang
+**  Creation Date     :     2013.06.25
+===============================================================================
+**/
+
+#include <cstring>
+#include <iostream>
+#include <QDir>
+#include <QFileInfo>
+#include <QImageReader>
+#include <QMutexLocker>
+#include <opencv2/imgproc/imgproc.hpp>
+#include "frameSource.h"
+
+frameSource* frameSource::open(const QString& path)
+{
+    QFileInfo info(path);
+    const QString suffix = info.suffix().toLower();
+    frameSource* source = NULL;
+    bool opened = true;
+    try {
+        if (info.isDir())
+        {
+            source = new jpegDirSource(path);
+        }
+        else if (suffix == "pack")
+        {
+            packedFileSource* packed = new packedFileSource(path);
+            opened = packed->isOpened();
+            source = packed;
+        }
+        else if (suffix == "bgr" || suffix == "yuv")
+        {
+            rawFileSource* raw = new rawFileSource(path, suffix == "bgr" ?
+                                                   rawFileSource::RAW_BGR24 : rawFileSource::RAW_I420);
+            opened = raw->isOpened();
+            source = raw;
+        }
+        else
+        {
+            videoFileSource* video = new videoFileSource(path);
+            opened = video->isOpened();
+            source = video;
+        }
+    }
+    catch (std::bad_alloc&)
+    {
+        std::cerr<<"Bad alloc!"<<std::endl;
+        throw;
+    }
+
+    if (!opened)
+    {
+        std::cerr<<"can't open frame source: "<<path.toAscii().data()<<std::endl;
+        delete source;
+        return NULL;
+    }
+    std::cout<<"frame source:"<<path.toAscii().data()<<" frames:"<<source->size()<<std::endl;
+    return source;
+}
+
+QImage frameSource::toImage(const cv::Mat& bgr)
+{
+    QImage image(bgr.cols, bgr.rows, QImage::Format_RGB32);
+    //RGB32 is B, G, R, A in memory, convert straight into its pixels
+    cv::Mat view(image.height(), image.width(), CV_8UC4, image.bits(), image.bytesPerLine());
+    cv::cvtColor(bgr, view, bgr.channels() == 1 ? CV_GRAY2BGRA : CV_BGR2BGRA);
+    return image;
+}
+
+//--------------------------------------------------------------------------
+//JPEG directory
+//--------------------------------------------------------------------------
+jpegDirSource::jpegDirSource(const QString& path)
+    : path_(path)
+{
+    if (!path_.endsWith('/'))
+      path_ += '/';
+    QDir dir(path_.toAscii().data(), "*.jpg");
+    files_ = dir.entryList();
+}
+
+//libjpeg scales by 1/2, 1/4 or 1/8 while decoding, a size it can reach
+//exactly is decoded with no extra resize pass
+QSize jpegDirSource::reducedSize(const QSize& full, const QSize& target)
+{
+    int denom = 8;
+    while (denom > 1 &&
+           ((full.width() + denom - 1) / denom < target.width() ||
+            (full.height() + denom - 1) / denom < target.height()))
+      denom /= 2;
+    return QSize((full.width() + denom - 1) / denom, (full.height() + denom - 1) / denom);
+}
+
+bool jpegDirSource::read(const int index, QImage& image)
+{
+    Q_ASSERT(index >= 0 && index < files_.size());
+    //header only, then decode straight at reduced size. inputManager
+    //does the small final resize to working size.
+    QImageReader reader(path_ + files_[index]);
+    const QSize full = reader.size();
+    if (full.isValid())
+    {
+        const QSize reduced = reducedSize(full, QSize(FRAME_WIDTH, FRAME_HEIGHT));
+        if (reduced != full)
+          reader.setScaledSize(reduced);
+    }
+    return reader.read(&image);
+}
+
+//--------------------------------------------------------------------------
+//video file
+//--------------------------------------------------------------------------
+videoFileSource::videoFileSource(const QString& path)
+    : capture_(path.toLocal8Bit().data()),
+      next_(0),
+      frames_(0),
+      fps_(1.0 / FRAME_INTERVAL),
+      directory_(QFileInfo(path).absolutePath() + '/')
+{
+    if (!capture_.isOpened())
+      return;
+    //containers without a rate keep the default
+    const double fps = capture_.get(CV_CAP_PROP_FPS);
+    if (fps > 0.0)
+      fps_ = fps;
+
+    frames_ = static_cast<int>(capture_.get(CV_CAP_PROP_FRAME_COUNT));
+    if (frames_ > 0)
+    {
+        timestamps_.assign(frames_, -1.0);
+        return;
+    }
+
+    //no count in the header, walk the stream once for count and clock
+    while (capture_.grab())
+      timestamps_.push_back(capture_.get(CV_CAP_PROP_POS_MSEC) / 1000.0);
+    frames_ = static_cast<int>(timestamps_.size());
+    capture_.set(CV_CAP_PROP_POS_FRAMES, 0);
+}
+
+int videoFileSource::size() const
+{
+    QMutexLocker locker(&mutex_);
+    return frames_;
+}
+
+double videoFileSource::timestamp(const int index) const
+{
+    QMutexLocker locker(&mutex_);
+    if (index >= 0 && index < static_cast<int>(timestamps_.size()) && timestamps_[index] >= 0.0)
+      return timestamps_[index];
+
+    //nearest frame read before index, its time plus header frame period
+    int known = qMin(index, static_cast<int>(timestamps_.size())) - 1;
+    while (known >= 0 && timestamps_[known] < 0.0)
+      --known;
+    if (known < 0)
+      return index / fps_;
+    return timestamps_[known] + (index - known) / fps_;
+}
+
+videoFileSource::~videoFileSource()
+{
+    capture_.release();
+}
+
+bool videoFileSource::read(const int index, QImage& image)
+{
+    Q_ASSERT(index >= 0);
+    QMutexLocker locker(&mutex_);
+    //prefetch may ask past a count that shrank
+    if (index >= frames_)
+      return false;
+
+    //seeking is slow and not exact in every container, only when asked
+    //out of order
+    const bool sequential = index == next_;
+    if (!sequential)
+      capture_.set(CV_CAP_PROP_POS_FRAMES, index);
+    next_ = index + 1;
+    if (!capture_.grab())
+    {
+        //stream ended early, header count was wrong. After a seek the
+        //seek itself may be what failed, keep the count then.
+        if (sequential)
+        {
+            std::cerr<<"video ends at frame "<<index<<" of "<<frames_<<std::endl;
+            frames_ = index;
+            timestamps_.resize(frames_);
+        }
+        return false;
+    }
+    timestamps_[index] = capture_.get(CV_CAP_PROP_POS_MSEC) / 1000.0;
+    if (!capture_.retrieve(bgr_) || bgr_.empty())
+      return false;
+    image = toImage(bgr_);
+    return true;
+}
+
+//--------------------------------------------------------------------------
+//raw dump
+//--------------------------------------------------------------------------
+rawFileSource::rawFileSource(const QString& path, const int format,
+                             const int width, const int height, const double fps)
+    : file_(path),
+      opened_(false),
+      format_(format),
+      width_(width),
+      height_(height),
+      fps_(fps),
+      frameBytes_(0),
+      frames_(0),
+      directory_(QFileInfo(path).absolutePath() + '/')
+{
+    Q_ASSERT(width_ > 0 && height_ > 0 && fps_ > 0.0);
+    Q_ASSERT(format_ != RAW_I420 || (width_ % 2 == 0 && height_ % 2 == 0));
+    frameBytes_ = static_cast<qint64>(width_) * height_ * (format_ == RAW_BGR24 ? 3 : 1);
+    if (format_ == RAW_I420)
+      frameBytes_ += frameBytes_ / 2;
+
+    if (!file_.open(QIODevice::ReadOnly))
+      return;
+    opened_ = true;
+    //a trailing partial frame is dropped
+    frames_ = static_cast<int>(file_.size() / frameBytes_);
+}
+
+rawFileSource::~rawFileSource()
+{
+    file_.close();
+}
+
+bool rawFileSource::read(const int index, QImage& image)
+{
+    Q_ASSERT(index >= 0 && index < frames_);
+    //I420 is one plane of height * 3/2 rows
+    cv::Mat raw;
+    if (format_ == RAW_BGR24)
+      raw.create(height_, width_, CV_8UC3);
+    else
+      raw.create(height_ + height_ / 2, width_, CV_8UC1);
+
+    {
+        QMutexLocker locker(&mutex_);
+        if (!file_.seek(index * frameBytes_) ||
+            file_.read(reinterpret_cast<char*>(raw.data), frameBytes_) != frameBytes_)
+        {
+            std::cerr<<"short raw frame "<<index<<std::endl;
+            return false;
+        }
+    }
+
+    //conversion runs outside the lock, workers overlap on it
+    if (format_ == RAW_BGR24)
+    {
+        image = toImage(raw);
+    }
+    else
+    {
+        cv::Mat bgr;
+        cv::cvtColor(raw, bgr, CV_YUV2BGR_I420);
+        image = toImage(bgr);
+    }
+    return true;
+}
+
+//--------------------------------------------------------------------------
+//packed container
+//--------------------------------------------------------------------------
+packedFileSource::packedFileSource(const QString& path)
+    : file_(path),
+      base_(NULL),
+      entries_(NULL),
+      directory_(QFileInfo(path).absolutePath() + '/')
+{
+    memset(&header_, 0, sizeof(header_));
+    if (!file_.open(QIODevice::ReadOnly))
+      return;
+
+    //whole file, pages come from the page cache on first touch
+    const qint64 fileSize = file_.size();
+    if (fileSize < static_cast<qint64>(sizeof(packedHeader)))
+    {
+        std::cerr<<"packed file too short"<<std::endl;
+        return;
+    }
+    base_ = file_.map(0, fileSize);
+    if (!base_)
+    {
+        std::cerr<<"can't map packed file: "<<file_.errorString().toAscii().data()<<std::endl;
+        return;
+    }
+    if (!validate(fileSize))
+    {
+        file_.unmap(base_);
+        base_ = NULL;
+        memset(&header_, 0, sizeof(header_));
+        entries_ = NULL;
+    }
+}
+
+packedFileSource::~packedFileSource()
+{
+    if (base_)
+      file_.unmap(base_);
+    file_.close();
+}
+
+//header and offset table must describe frames inside the file
+bool packedFileSource::validate(const qint64 fileSize)
+{
+    memcpy(&header_, base_, sizeof(header_));
+    if (strncmp(header_.magic, PACKED_MAGIC, sizeof(header_.magic)) != 0 ||
+        header_.version != PACKED_VERSION)
+    {
+        std::cerr<<"not a packed frame file"<<std::endl;
+        return false;
+    }
+    if (header_.width == 0 || header_.height == 0 ||
+        (header_.channels != 1 && header_.channels != 3) ||
+        header_.frameBytes != header_.width * header_.height * header_.channels ||
+        header_.tableOffset % sizeof(quint64) != 0 ||
+        header_.frameBytes > static_cast<quint64>(fileSize) ||
+        header_.tableOffset > static_cast<quint64>(fileSize) ||
+        static_cast<quint64>(header_.frameCount) * sizeof(packedEntry) >
+        static_cast<quint64>(fileSize) - header_.tableOffset)
+    {
+        std::cerr<<"bad packed header"<<std::endl;
+        return false;
+    }
+
+    //compared by subtraction, a crafted offset could wrap offset + size
+    //past the file end
+    const quint64 lastOffset = static_cast<quint64>(fileSize) - header_.frameBytes;
+    entries_ = reinterpret_cast<const packedEntry*>(base_ + header_.tableOffset);
+    for (quint32 i = 0; i < header_.frameCount; ++i)
+    {
+        if (entries_[i].offset > lastOffset ||
+            entries_[i].nameLength >= PACKED_NAME_SIZE ||
+            entries_[i].name[entries_[i].nameLength] != 0)
+        {
+            std::cerr<<"bad packed entry "<<i<<std::endl;
+            return false;
+        }
+    }
+    return true;
+}
+
+bool packedFileSource::view(const int index, cv::Mat& frame) const
+{
+    Q_ASSERT(index >= 0 && index < size());
+    frame = cv::Mat(header_.height, header_.width, CV_8UC(header_.channels),
+                    base_ + entries_[index].offset);
+    return true;
+}
+
+//for callers that want a QImage, costs a conversion
+bool packedFileSource::read(const int index, QImage& image)
+{
+    cv::Mat frame;
+    if (!view(index, frame))
+      return false;
+    image = toImage(frame);
+    return true;
+}
@@ -0,0 +1,194 @@
+/*=============================================================================
+**                            MODULE SPECIFICATION
+===============================================================================
+**
+**  Title : Frame sources
+**
+**  Description : Where inputManager gets its frames from. A source knows how
+**                many frames it has, names and timestamps each one, and
+**                decodes frame i into a RGB32 QImage. Sources are a JPEG
+**                directory, a video file read by cv::VideoCapture, a raw
+**                BGR24 or I420 camera dump, and a mapped packed container
+**                whose frames are viewed in place.
+**
+**
+===============================================================================
+**  Author            :     Xin Zhang
+**  Creation Date     :     2013.06.25
+===============================================================================
+**/
+
+#ifndef NAVPRO_FRAME_SOURCE_H_
+#define NAVPRO_FRAME_SOURCE_H_
+
+#include <vector>
+#include <QFile>
+#include <QImage>
+#include <QMutex>
+#include <QString>
+#include <QStringList>
+#include <opencv2/core/core.hpp>
+#include <opencv2/highgui/highgui.hpp>
+
+#include "environment.h"
+#include "packedFrames.h"
+
+class frameSource
+{
+  public:
+    virtual ~frameSource() {}
+
+    // source for path: a directory of *.jpg, a *.bgr or *.yuv raw dump,
+    // a *.pack container, or else a video file. NULL when it can't be
+    // opened.
+    static frameSource* open(const QString& path);
+
+    virtual int size() const = 0;
+    // key of frame in the ego-motion log
+    virtual QString name(const int index) const = 0;
+    // seconds since first frame
+    virtual double timestamp(const int index) const = 0;
+    // decode frame index into image, safe to call from several threads
+    virtual bool read(const int index, QImage& image) = 0;
+    // false when frames are cheap only in order, prefetch then decodes
+    // them one at a time in order
+    virtual bool randomAccess() const { return true; }
+    // frames are already decoded in memory, view() hands them out
+    virtual bool zeroCopy() const { return false; }
+    // CV_8UC3 BGR or CV_8UC1 gray header over frame index, no copy. Valid
+    // while the source lives.
+    virtual bool view(const int index, cv::Mat& frame) const
+    {
+        (void)index;
+        (void)frame;
+        return false;
+    }
+    // directory holding the ego-motion log, ends with '/'
+    virtual QString directory() const = 0;
+
+  protected:
+    // BGR or gray Mat into a new RGB32 image of same size
+    static QImage toImage(const cv::Mat& bgr);
+};
+
+// every *.jpg of a directory, in name order. Large JPEGs are decoded at
+// 1/2, 1/4 or 1/8 size in the DCT domain, whichever is nearest to but
+// not below FRAME_WIDTH x FRAME_HEIGHT.
+class jpegDirSource : public frameSource
+{
+  public:
+    explicit jpegDirSource(const QString& path);
+
+    int size() const { return files_.size(); }
+    QString name(const int index) const { return files_[index]; }
+    double timestamp(const int index) const { return index * FRAME_INTERVAL; }
+    bool read(const int index, QImage& image);
+    QString directory() const { return path_; }
+    // size libjpeg decodes full at when target is wanted
+    static QSize reducedSize(const QSize& full, const QSize& target);
+
+  private:
+    QString path_;
+    QStringList files_;
+};
+
+// any file cv::VideoCapture opens, frames are named by their number
+class videoFileSource : public frameSource
+{
+  public:
+    explicit videoFileSource(const QString& path);
+    ~videoFileSource();
+
+    bool isOpened() const { return capture_.isOpened(); }
+    // header's frame count, shrinks to the real one when a read fails
+    // before it
+    int size() const;
+    QString name(const int index) const { return QString::number(index); }
+    // decoder's time of frames already read, so variable frame rate
+    // streams keep their clock. Frames ahead are estimated at header fps.
+    double timestamp(const int index) const;
+    bool read(const int index, QImage& image);
+    bool randomAccess() const { return false; }
+    QString directory() const { return directory_; }
+
+  private:
+    cv::VideoCapture capture_;
+    //decoder state, capture_ is not reentrant
+    mutable QMutex mutex_;
+    //frame next read() of capture_ returns
+    int next_;
+    int frames_;
+    double fps_;
+    //seconds of frame i from CV_CAP_PROP_POS_MSEC, negative until read
+    std::vector<double> timestamps_;
+    QString directory_;
+    cv::Mat bgr_;
+};
+
+// headerless dump of fixed size frames
+class rawFileSource : public frameSource
+{
+  public:
+    enum {
+      RAW_BGR24 = 0,
+      // planar Y, then U and V at half width and height
+      RAW_I420
+    };
+
+    rawFileSource(const QString& path, const int format,
+                  const int width = RAW_FRAME_WIDTH, const int height = RAW_FRAME_HEIGHT,
+                  const double fps = 1.0 / FRAME_INTERVAL);
+    ~rawFileSource();
+
+    bool isOpened() const { return opened_; }
+    int size() const { return frames_; }
+    QString name(const int index) const { return QString::number(index); }
+    double timestamp(const int index) const { return index / fps_; }
+    bool read(const int index, QImage& image);
+    QString directory() const { return directory_; }
+
+  private:
+    QFile file_;
+    //seek and read of file_ go together
+    QMutex mutex_;
+    bool opened_;
+    int format_;
+    int width_;
+    int height_;
+    double fps_;
+    qint64 frameBytes_;
+    int frames_;
+    QString directory_;
+};
+
+// packed container mapped into memory, see packedFrames.h
+class packedFileSource : public frameSource
+{
+  public:
+    explicit packedFileSource(const QString& path);
+    ~packedFileSource();
+
+    bool isOpened() const { return base_ != NULL; }
+    int size() const { return header_.frameCount; }
+    QString name(const int index) const
+    {
+        return QString::fromAscii(entries_[index].name, entries_[index].nameLength);
+    }
+    double timestamp(const int index) const { return entries_[index].timestamp; }
+    bool read(const int index, QImage& image);
+    bool zeroCopy() const { return true; }
+    bool view(const int index, cv::Mat& frame) const;
+    QString directory() const { return directory_; }
+
+  private:
+    bool validate(const qint64 fileSize);
+
+    QFile file_;
+    uchar* base_;
+    packedHeader header_;
+    //offset table inside the mapping
+    const packedEntry* entries_;
+    QString directory_;
+};
+
+#endif //NAVPRO_FRAME_SOURCE_H_
@@ -1,39 +1,269 @@
 #include <cassert>
 #include <iostream>
-#include <QDir>
+#include <QElapsedTimer>
+#include <QFile>
+#include <QMutexLocker>
+#include <QRunnable>
+#include <QStringList>
+#include <QTextStream>
 #include "inputManager.h"
 
+//decodes and scales one frame, hands it back through decoded()
+class inputManager::decodeTask : public QRunnable
+{
+  public:
+    decodeTask(inputManager* input, const int index)
+      : p_input_(input),
+        index_(index)
+    {
+    }
+
+    void run()
+    {
+        QElapsedTimer timer;
+        timer.start();
+        QImage image;
+        p_input_->load(index_, image);
+        p_input_->decoded(index_, image, timer.elapsed());
+    }
+
+  private:
+    inputManager* p_input_;
+    int index_;
+};
+
 inputManager::inputManager(QString& imagePath)
     : input_path_(imagePath),
-      cur_image_(0)
+      source_(NULL),
+      cur_image_(0),
+      depth_(0),
+      workers_(0),
+      decoded_count_(0),
+      decode_ms_(0),
+      max_decode_ms_(0),
+      stalls_(0),
+      wait_ms_(0)
+{
+    source_ = frameSource::open(input_path_);
+    if (source_)
+      loadEgoMotion();
+    setPrefetch(DEFAULT_DECODE_WORKERS, DEFAULT_READ_AHEAD);
+}
+
+void inputManager::setPrefetch(const int workers, const int depth)
+{
+    Q_ASSERT(workers > 0 && depth >= 0);
+    //frames in flight belong to the old ring
+    pool_.waitForDone();
+
+    QMutexLocker locker(&mutex_);
+    //sequential sources decode one frame at a time, in queue order.
+    //Mapped frames need no decode, the page cache is their read-ahead.
+    workers_ = (source_ && !source_->randomAccess()) ? 1 : workers;
+    depth_ = (source_ && source_->zeroCopy()) ? 0 : depth;
+    //next() looks a sequential source's next frame up in the ring, keep
+    //one slot so it is decoded once
+    if (source_ && !source_->randomAccess())
+      depth_ = qMax(depth_, 1);
+    pool_.setMaxThreadCount(workers_);
+    frames_.resize(depth_);
+    for (int i = 0; i < depth_; ++i)
+    {
+        frames_[i].index = -1;
+        frames_[i].ready = false;
+        frames_[i].image = QImage();
+    }
+    for (int i = cur_image_; i < cur_image_ + depth_; ++i)
+      schedule(i);
+}
+
+//take slot of index and queue its decode, nothing past last image and
+//nothing already queued or decoded
+void inputManager::schedule(const int index)
 {
-    QDir dir(input_path_.toAscii().data(),"*.jpg");
-    image_list_ = dir.entryList();
+    if (depth_ == 0 || index < 0 || index >= frameCount())
+      return;
+
+    frameSlot& slot = frames_[index % depth_];
+    if (slot.index == index)
+      return;
+    slot.index = index;
+    slot.ready = false;
+    slot.image = QImage();
+    pool_.start(new decodeTask(this, index));
+}
+
+//decode and scale frame index, null image when the source fails
+void inputManager::load(const int index, QImage& image)
+{
+    if (!source_->read(index, image) || image.isNull())
+    {
+        std::cerr<<"decode failed: "<<source_->name(index).toAscii().data()<<std::endl;
+        image = QImage();
+        return;
+    }
+    scale(image);
+}
+
+//worker thread: keep image unless its slot was taken by a later frame
+void inputManager::decoded(const int index, const QImage& image, const qint64 ms)
+{
+    QMutexLocker locker(&mutex_);
+    ++decoded_count_;
+    decode_ms_ += ms;
+    max_decode_ms_ = qMax(max_decode_ms_, ms);
+
+    if (depth_ == 0)
+      return;
+    frameSlot& slot = frames_[index % depth_];
+    if (slot.index != index)
+      return;
+    slot.image = image;
+    slot.ready = true;
+    frame_ready_.wakeAll();
+}
+
+prefetchStats inputManager::getPrefetchStats() const
+{
+    QMutexLocker locker(&mutex_);
+    prefetchStats stats;
+    for (int i = 0; i < frames_.size(); ++i)
+    {
+        if (frames_[i].ready && frames_[i].index >= cur_image_)
+          ++stats.ready;
+    }
+    stats.depth = depth_;
+    stats.workers = workers_;
+    stats.decoded = decoded_count_;
+    if (decoded_count_ > 0)
+      stats.meanDecode = static_cast<float>(decode_ms_) / decoded_count_;
+    stats.maxDecode = max_decode_ms_;
+    stats.stalls = stalls_;
+    if (stalls_ > 0)
+      stats.meanWait = static_cast<float>(wait_ms_) / stalls_;
+    return stats;
+}
+
+//ego-motion log stands in for vehicle odometry until it is wired in.
+//Each line is "image,speed,yaw_rate", lines starting with '#' are comments.
+void inputManager::loadEgoMotion()
+{
+    QFile file(source_->directory() + EGO_MOTION_FILE);
+    if (!file.open(QIODevice::ReadOnly | QIODevice::Text))
+      return;
+
+    QTextStream in(&file);
+    QString line;
+    QStringList fields;
+    egoMotion motion;
+    bool speedOk, yawOk;
+    while (!in.atEnd())
+    {
+        line = in.readLine().trimmed();
+        if (line.isEmpty() || line.startsWith('#'))
+          continue;
+
+        fields = line.split(',');
+        if (fields.size() < 3)
+        {
+            std::cerr<<"Bad ego-motion line: "<<line.toAscii().data()<<std::endl;
+            continue;
+        }
+        motion.speed = fields[1].trimmed().toFloat(&speedOk);
+        motion.yawRate = fields[2].trimmed().toFloat(&yawOk);
+        if (!speedOk || !yawOk)
+        {
+            std::cerr<<"Bad ego-motion line: "<<line.toAscii().data()<<std::endl;
+            continue;
+        }
+        ego_motion_.insert(fields[0].trimmed(), motion);
+    }
+    std::cout<<"ego-motion entries:"<<ego_motion_.size()<<std::endl;
+}
+
+bool inputManager::getEgoMotion(float& speed, float& yawRate) const
+{
+    speed = 0.0;
+    yawRate = 0.0;
+    if (cur_image_ >= frameCount())
+      return false;
+
+    const QString name = source_->name(cur_image_);
+    if (!ego_motion_.contains(name))
+      return false;
+
+    const egoMotion motion = ego_motion_.value(name);
+    speed = motion.speed;
+    yawRate = motion.yawRate;
+    return true;
 }
 
 inputManager::~inputManager()
 {
+    //workers call back into this object
+    pool_.waitForDone();
+    delete source_;
+}
+
+//seconds from current frame to next one, by the source's clock
+double inputManager::getFrameInterval() const
+{
+    if (cur_image_ + 1 >= frameCount())
+      return FRAME_INTERVAL;
+    const double interval = source_->timestamp(cur_image_ + 1) - source_->timestamp(cur_image_);
+    return interval > 0.0 ? interval : FRAME_INTERVAL;
 }
 
 bool inputManager::getCurrentImage(QImage& image)
 {
     bool retValue = false;
-    if (image_list_.size() > 0 && cur_image_ < image_list_.size())
+    if (frameCount() > 0 && cur_image_ < frameCount())
     {
-        std::cout<<"image:"<<QString(input_path_ + image_list_[cur_image_]).toAscii().data()<<std::endl;
-        image.load(input_path_ + image_list_[cur_image_]);
-        scale(image);
-        retValue =  true;
+        VERBOSE_LOG("image:"<<source_->name(cur_image_).toAscii().data()
+                    <<" time:"<<source_->timestamp(cur_image_));
+        if (depth_ == 0)
+        {
+            load(cur_image_, image);
+            return !image.isNull();
+        }
+
+        QMutexLocker locker(&mutex_);
+        if (!waitFor(cur_image_))
+          return false;
+        //implicitly shared, no pixel copy, null when the frame didn't decode
+        image = frames_[cur_image_ % depth_].image;
+        retValue = !image.isNull();
     }
     return retValue;
 }
 
+bool inputManager::getCurrentFrame(videoFrame& frame)
+{
+    //view straight into the source, no decode and no copy
+    if (source_ && source_->zeroCopy() && cur_image_ < frameCount())
+    {
+        VERBOSE_LOG("image:"<<source_->name(cur_image_).toAscii().data()
+                    <<" time:"<<source_->timestamp(cur_image_));
+        cv::Mat view;
+        if (!source_->view(cur_image_, view))
+          return false;
+        frame.setMat(view);
+        return true;
+    }
+
+    QImage image;
+    if (!getCurrentImage(image))
+      return false;
+    frame.setImage(image);
+    return true;
+}
+
 bool inputManager::getCurrentImagePath(QString& path)
 {
     bool retValue = false;
-    if (image_list_.size() > 0 && cur_image_ < image_list_.size())
+    if (frameCount() > 0 && cur_image_ < frameCount())
     {
-        path = QString(input_path_ + image_list_[cur_image_]);
+        path = source_->directory() + source_->name(cur_image_);
         retValue =  true;
     }
     return retValue;
@@ -42,13 +272,12 @@ bool inputManager::getCurrentImagePath(QString& path)
 bool inputManager::getNextImage(QImage& image)
 {
     bool retValue = false;
-    //std::cout<<"Cur: "<<count<<" of : "<<image_list_.size()<<std::endl; 
-    if (image_list_.size() > 0 && cur_image_ < image_list_.size())
+    //std::cout<<"Cur: "<<count<<" of : "<<frameCount()<<std::endl; 
+    if (frameCount() > 0 && cur_image_ < frameCount())
     {
-        image.load(input_path_ + image_list_[cur_image_]);
-        scale(image);
-        retValue =  true;
-        cur_image_++;
+        //move past a frame that failed to decode all the same
+        retValue = getCurrentImage(image);
+        advance();
     }
     return retValue;
 }
@@ -57,29 +286,76 @@ bool inputManager::getNextImagePath(QString& path)
 {
     bool retValue = false;
     int next_image = cur_image_ + 1;
-    if (image_list_.size() > 0 && next_image < image_list_.size())
+    if (frameCount() > 0 && next_image < frameCount())
     {
-        path = QString(input_path_ + image_list_[next_image]);
+        path = source_->directory() + source_->name(next_image);
         retValue =  true;
     }
     return retValue;
 }
 
+//stays on last image and returns false once there is no next one
 bool inputManager::next()
 {
     bool retValue = false;
 
-    if (image_list_.size() > 0 && cur_image_ < image_list_.size())
+    if (cur_image_ + 1 < frameCount() && exists(cur_image_ + 1))
     {
         retValue =  true;
-        cur_image_++;
+        advance();
     }
     return retValue;
 }
 
+//a sequential source learns its real length only by decoding, a failed
+//read past the last real frame shrinks frameCount(). Wait for index's
+//decode, which is needed next anyway, so callers stop on the last frame
+//instead of stepping past it. A frame that fails inside the stream still
+//exists, callers skip it.
+bool inputManager::exists(const int index)
+{
+    if (source_->randomAccess())
+      return true;
+    QMutexLocker locker(&mutex_);
+    waitFor(index);
+    return index < frameCount();
+}
+
+//call with mutex_ held, schedules index if it isn't yet and blocks until
+//its slot is ready. False when index can't be scheduled.
+bool inputManager::waitFor(const int index)
+{
+    frameSlot& slot = frames_[index % depth_];
+    schedule(index);
+    if (slot.index != index)
+      return false;
+    if (!slot.ready)
+    {
+        //decode fell behind processing
+        QElapsedTimer timer;
+        timer.start();
+        while (slot.index != index || !slot.ready)
+          frame_ready_.wait(&mutex_);
+        ++stalls_;
+        wait_ms_ += timer.elapsed();
+    }
+    return true;
+}
+
+//current frame's slot is free now, refill it with the frame depth ahead
+void inputManager::advance()
+{
+    QMutexLocker locker(&mutex_);
+    cur_image_++;
+    schedule(cur_image_ + depth_ - 1);
+}
+
+//working resolution and format of every consumer, done once per frame
 void inputManager::scale(QImage& image)
 {
-  //do scaling with given height
-  assert(FRAME_WIDTH > 0);
-  image = image.scaledToWidth(FRAME_WIDTH);
+  assert(FRAME_WIDTH > 0 && FRAME_HEIGHT > 0);
+  if (image.width() != FRAME_WIDTH || image.height() != FRAME_HEIGHT)
+    image = image.scaled(FRAME_WIDTH, FRAME_HEIGHT, Qt::IgnoreAspectRatio, Qt::SmoothTransformation);
+  if (image.format() != QImage::Format_RGB32)
+    image = image.convertToFormat(QImage::Format_RGB32);
 }
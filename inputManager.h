@@ -2,28 +2,129 @@
 #define INPUTSTREAM_H
 
 #include <QImage>
+#include <QMap>
+#include <QMutex>
 #include <QString>
+#include <QThreadPool>
+#include <QVector>
+#include <QWaitCondition>
 #include "environment.h"
+#include "frameSource.h"
+#include "videoFrame.h"
+
+//decode pipeline state, times in milliseconds
+struct prefetchStats
+{
+  //frames from current one on that are decoded and waiting
+  int ready;
+  int depth;
+  int workers;
+  int decoded;
+  float meanDecode;
+  float maxDecode;
+  //getCurrentImage() had to wait for its frame
+  int stalls;
+  float meanWait;
+
+  prefetchStats()
+    : ready(0),
+      depth(0),
+      workers(0),
+      decoded(0),
+      meanDecode(0.0),
+      maxDecode(0.0),
+      stalls(0),
+      meanWait(0.0)
+  {
+  }
+};
 
 class inputManager
 {
   public:
+    const static int DEFAULT_DECODE_WORKERS = 2;
+    const static int DEFAULT_READ_AHEAD = 4;
+
+    // inputPath is anything frameSource::open() takes, a directory of
+    // JPEGs, a video file or a raw dump
     inputManager(QString& inputPath);
     ~inputManager();
-    
+
+    // decode and scale images on workers background threads, keeping up
+    // to depth frames from current one on ready. depth 0 decodes on the
+    // caller's thread inside getCurrentImage(), except for sequential
+    // sources such as videos, which always keep one frame ahead.
+    void setPrefetch(const int workers, const int depth);
+    prefetchStats getPrefetchStats() const;
+
+    // frames are RGB32 at FRAME_WIDTH x FRAME_HEIGHT, false when there is
+    // no current frame or it failed to decode
     bool getCurrentImage(QImage& image);
+    // same pixels viewed by both Qt and OpenCV, nothing is copied. Frames
+    // of a packed container are views into its mapping.
+    bool getCurrentFrame(videoFrame& frame);
+    // source directory plus frame name, a file only for JPEG directories
     bool getCurrentImagePath(QString& path);
 
+    // current frame as getCurrentImage(), then advance even when it failed
     bool getNextImage(QImage& image);
     bool getNextImagePath(QString& path);
+    // false on last frame, for videos the last one that really decodes
+    // whatever their header claims
     bool next();
+    // seconds from current frame to next one, from source timestamps
+    double getFrameInterval() const;
+
+    //vehicle motion from current image to next one, speed in m/s and yaw
+    //rate in rad/s (left positive). Both are 0 and false is returned when
+    //the ego-motion log has no entry for current image.
+    bool getEgoMotion(float& speed, float& yawRate) const;
   private:
-    void scale(QImage& image);
+    //one line of ego-motion log
+    struct egoMotion
+    {
+      float speed;
+      float yawRate;
+    };
+
+    //ring entry, frame index lives in slot index % read-ahead depth
+    struct frameSlot
+    {
+      int index;
+      bool ready;
+      QImage image;
+    };
+    class decodeTask;
+
+    static void scale(QImage& image);
+    void load(const int index, QImage& image);
+    int frameCount() const { return source_ ? source_->size() : 0; }
+    void loadEgoMotion();
+    //call with mutex_ held
+    void schedule(const int index);
+    bool waitFor(const int index);
+    bool exists(const int index);
+    void decoded(const int index, const QImage& image, const qint64 ms);
+    void advance();
 
-    //support file list in a Dir
-    QStringList image_list_;
     QString input_path_;
+    frameSource* source_;
     int cur_image_;
+    //image file name -> motion, read from EGO_MOTION_FILE in input dir
+    QMap<QString, egoMotion> ego_motion_;
+
+    //prefetch ring, workers finish through decoded()
+    QThreadPool pool_;
+    mutable QMutex mutex_;
+    QWaitCondition frame_ready_;
+    QVector<frameSlot> frames_;
+    int depth_;
+    int workers_;
+    int decoded_count_;
+    qint64 decode_ms_;
+    qint64 max_decode_ms_;
+    int stalls_;
+    qint64 wait_ms_;
 };
 
 #endif  //INPUTSTREAM_H
@@ -0,0 +1,265 @@
+/*=============================================================================
+**                            MODULE SPECIFICATION
+===============================================================================
+**
+**  Title : Lane model particle filter
+**
+**  Description : Particles are lane hypotheses scored on sparse projected
+**                samples, see laneModelFilter.h
+**
+**
+===============================================================================
+**  Author            :     Xin Zhang
+**  Creation Date     :     2013.06.10
+===============================================================================
+**/
+
+#include <algorithm>
+#include <iostream>
+#include "coordinateSystems.h"
+#include "laneModelFilter.h"
+
+//sigma in pixels of a boundary sample against nearest feature
+static const float SAMPLE_NOISE = 10.0;
+//added to road probability before its log
+static const float ROAD_FLOOR = 0.01;
+//nearest and farthest sample, meters ahead
+static const float NEAR_DISTANCE = 6.0;
+static const float FAR_DISTANCE = 40.0;
+//narrowest lane a hypothesis may drift to, meters
+static const float MIN_LANE_WIDTH = 2.0;
+
+void laneModelFilter::laneSet::resize(const int n)
+{
+    offset.resize(n);
+    yaw.resize(n);
+    width.resize(n);
+    curvature.resize(n);
+    weight.resize(n);
+}
+
+laneModelFilter::laneModelFilter(const int count)
+    : particleCount(count),
+    processNoise(0.1, 0.01, 0.05, 0.0002)
+{
+    Q_ASSERT(particleCount > 0);
+    lanes.resize(particleCount);
+    spare.resize(particleCount);
+
+    gaussian.build(SAMPLE_NOISE, static_cast<int>(sqrt(static_cast<double>(FRAME_WIDTH * FRAME_WIDTH +
+                                                                           FRAME_HEIGHT * FRAME_HEIGHT))) + 2);
+    buildSamples();
+    scatter();
+}
+
+laneModelFilter::~laneModelFilter()
+{
+}
+
+//samples are spaced geometrically so they spread evenly over image rows.
+//With camera pitch only, a road point's row depends on distance alone and
+//its column is linear in lateral position, so two projections per sample
+//give everything a particle needs.
+void laneModelFilter::buildSamples()
+{
+    const float ratio = FAR_DISTANCE / NEAR_DISTANCE;
+    for(int i = 0; i < NUMBER_OF_SAMPLES; ++i)
+    {
+        sampleDistance[i] = NEAR_DISTANCE * pow(ratio, static_cast<float>(i) / (NUMBER_OF_SAMPLES - 1));
+        Point centre = RCS2IPCS(Point3D(sampleDistance[i], 0.0, 0.0));
+        Point left = RCS2IPCS(Point3D(sampleDistance[i], 1.0, 0.0));
+        sampleRow[i] = static_cast<int>(centre.getY());
+        sampleColumn[i] = centre.getX();
+        sampleScale[i] = centre.getX() - left.getX();
+    }
+}
+
+void laneModelFilter::scatter()
+{
+    for(int k = 0; k < particleCount; ++k)
+    {
+        lanes.offset[k] = 2.0 * random.uniform() - 1.0;
+        lanes.yaw[k] = 0.2 * random.uniform() - 0.1;
+        lanes.width[k] = 3.0 + random.uniform();
+        lanes.curvature[k] = 0.004 * random.uniform() - 0.002;
+        lanes.weight[k] = 0.0;
+    }
+}
+
+void laneModelFilter::seed(const quint64 value)
+{
+    random.seed(value);
+    scatter();
+}
+
+//mean log likelihood of both boundaries against a distance map, samples
+//off the map count as far from any feature
+float laneModelFilter::scoreDistance(const cv::Mat& distance, const int k) const
+{
+    const float* logTable = gaussian.logData();
+    const int last = gaussian.size() - 1;
+    float logSum = 0.0;
+    float centre, half, u;
+    int i, side, d;
+    half = lanes.width[k] / 2.0;
+    for(i = 0; i < NUMBER_OF_SAMPLES; ++i)
+    {
+        centre = -lanes.offset[k] - lanes.yaw[k] * sampleDistance[i] +
+                 lanes.curvature[k] * sampleDistance[i] * sampleDistance[i] / 2.0;
+        for(side = -1; side <= 1; side += 2)
+        {
+            u = sampleColumn[i] - (centre + side * half) * sampleScale[i];
+            if (u < 0 || u >= distance.cols || sampleRow[i] < 0 || sampleRow[i] >= distance.rows)
+            {
+                logSum += logTable[last];
+                continue;
+            }
+            d = static_cast<int>(distance.at<float>(sampleRow[i], static_cast<int>(u)));
+            logSum += logTable[qMin(d, last)];
+        }
+    }
+    return logSum / (2 * NUMBER_OF_SAMPLES);
+}
+
+//mean log road probability along the lane centre
+float laneModelFilter::scoreRoad(const cv::Mat& road, const int k) const
+{
+    float logSum = 0.0;
+    float u, p;
+    for(int i = 0; i < NUMBER_OF_SAMPLES; ++i)
+    {
+        u = sampleColumn[i] - (-lanes.offset[k] - lanes.yaw[k] * sampleDistance[i] +
+                               lanes.curvature[k] * sampleDistance[i] * sampleDistance[i] / 2.0) * sampleScale[i];
+        p = (u >= 0 && u < road.cols && sampleRow[i] >= 0 && sampleRow[i] < road.rows) ?
+            road.at<float>(sampleRow[i], static_cast<int>(u)) : 0.0;
+        logSum += log(ROAD_FLOOR + p);
+    }
+    return logSum / NUMBER_OF_SAMPLES;
+}
+
+void laneModelFilter::measurementUpdate(const cv::Mat& edgeDistance, const cv::Mat& markerDistance,
+                                        const cv::Mat& roadProbability)
+{
+    if (edgeDistance.empty() && markerDistance.empty() && roadProbability.empty())
+      return;
+
+    float logSum;
+    for(int k = 0; k < particleCount; ++k)
+    {
+        logSum = 0.0;
+        if (!edgeDistance.empty())
+          logSum += scoreDistance(edgeDistance, k);
+        if (!markerDistance.empty())
+          logSum += scoreDistance(markerDistance, k);
+        if (!roadProbability.empty())
+          logSum += scoreRoad(roadProbability, k);
+        lanes.weight[k] = exp(logSum);
+    }
+}
+
+void laneModelFilter::resample()
+{
+    double total = 0.0;
+    int k;
+    for(k = 0; k < particleCount; ++k)
+      total += lanes.weight[k];
+    if (total <= 0.0)
+      return;
+
+    const double step = total / particleCount;
+    const double u = random.uniform();
+    double cumulative = lanes.weight[0];
+    int j = 0;
+    for(k = 0; k < particleCount; ++k)
+    {
+        while ((k + u) * step > cumulative && j < particleCount - 1)
+        {
+            ++j;
+            cumulative += lanes.weight[j];
+        }
+        spare.offset[k] = lanes.offset[j];
+        spare.yaw[k] = lanes.yaw[j];
+        spare.width[k] = lanes.width[j];
+        spare.curvature[k] = lanes.curvature[j];
+        spare.weight[k] = lanes.weight[j];
+    }
+
+    std::swap(lanes, spare);
+}
+
+void laneModelFilter::diffuse()
+{
+    for(int k = 0; k < particleCount; ++k)
+    {
+        lanes.offset[k] += processNoise.offset * random.normal();
+        lanes.yaw[k] += processNoise.yaw * random.normal();
+        lanes.width[k] = qMax(MIN_LANE_WIDTH, lanes.width[k] + processNoise.width * random.normal());
+        lanes.curvature[k] += processNoise.curvature * random.normal();
+    }
+}
+
+void laneModelFilter::predict(const float speed, const float yawRate, const float interval)
+{
+    const float distance = speed * interval;
+    const float turn = yawRate * interval;
+    for(int k = 0; k < particleCount; ++k)
+    {
+        //centre line seen from distance meters further along
+        lanes.offset[k] += lanes.yaw[k] * distance - lanes.curvature[k] * distance * distance / 2.0;
+        lanes.yaw[k] += turn - lanes.curvature[k] * distance;
+
+        //vehicle crossed a boundary, it is now in the neighbouring lane
+        if (lanes.offset[k] > lanes.width[k] / 2.0)
+          lanes.offset[k] -= lanes.width[k];
+        else if (lanes.offset[k] < -lanes.width[k] / 2.0)
+          lanes.offset[k] += lanes.width[k];
+    }
+    diffuse();
+}
+
+laneModel laneModelFilter::getEstimate() const
+{
+    double total = 0.0;
+    double offset = 0.0, yaw = 0.0, width = 0.0, curvature = 0.0;
+    double w;
+    for(int k = 0; k < particleCount; ++k)
+    {
+        //no weights yet, every hypothesis counts the same
+        w = lanes.weight[k] > 0.0 ? lanes.weight[k] : 0.0;
+        total += w;
+        offset += w * lanes.offset[k];
+        yaw += w * lanes.yaw[k];
+        width += w * lanes.width[k];
+        curvature += w * lanes.curvature[k];
+    }
+
+    if (total <= 0.0)
+    {
+        for(int k = 0; k < particleCount; ++k)
+        {
+            offset += lanes.offset[k];
+            yaw += lanes.yaw[k];
+            width += lanes.width[k];
+            curvature += lanes.curvature[k];
+        }
+        total = particleCount;
+    }
+
+    return laneModel(offset / total, yaw / total, width / total, curvature / total);
+}
+
+void laneModelFilter::project(const laneModel& lane, std::vector<cv::Point>& left, std::vector<cv::Point>& right) const
+{
+    left.clear();
+    right.clear();
+    float centre;
+    for(int i = 0; i < NUMBER_OF_SAMPLES; ++i)
+    {
+        centre = -lane.offset - lane.yaw * sampleDistance[i] +
+                 lane.curvature * sampleDistance[i] * sampleDistance[i] / 2.0;
+        left.push_back(cv::Point(static_cast<int>(sampleColumn[i] - (centre + lane.width / 2.0) * sampleScale[i]),
+                                 sampleRow[i]));
+        right.push_back(cv::Point(static_cast<int>(sampleColumn[i] - (centre - lane.width / 2.0) * sampleScale[i]),
+                                  sampleRow[i]));
+    }
+}
@@ -0,0 +1,129 @@
+/*=============================================================================
+**                            MODULE SPECIFICATION
+===============================================================================
+**
+**  Title : Lane model particle filter
+**
+**  Description : Particles are lane hypotheses instead of image pixels:
+**                lateral offset, yaw, lane width and curvature in the road
+**                coordinate system (RCS). Each hypothesis is projected to a
+**                few dozen image samples through RCS2IPCS and only scored
+**                there against the cue maps of the pixel filter.
+**
+**                Source from:
+**                Vision based lane tracking using multiple cues and particle
+**                filtering
+**                --Nicholas Apostoloff ANU
+**
+===============================================================================
+**  Author            :     Xin Zhang
+**  Creation Date     :     2013.06.10
+===============================================================================
+**/
+
+#ifndef NAVPRO_LANE_MODEL_FILTER_H_
+#define NAVPRO_LANE_MODEL_FILTER_H_
+
+#include <vector>
+#include <opencv2/core/core.hpp>
+
+#include "environment.h"
+#include "likelihoodTable.h"
+#include "randomGenerator.h"
+
+//one lane hypothesis, centre line at distance X ahead of the camera is
+//Y(X) = -offset - yaw * X + curvature * X^2 / 2, boundaries are +-width/2
+struct laneModel
+{
+  //vehicle left of lane centre, meters
+  float offset;
+  //vehicle heading left of lane direction, radians
+  float yaw;
+  //meters
+  float width;
+  //lane bends left, 1/meters
+  float curvature;
+
+  laneModel(float o = 0.0, float y = 0.0, float w = 3.5, float c = 0.0)
+    : offset(o),
+    yaw(y),
+    width(w),
+    curvature(c)
+  {
+  }
+};
+
+class laneModelFilter
+{
+  public:
+    const static int NUMBER_OF_PARTICLES = 1000;
+    // distances ahead a hypothesis is sampled at
+    const static int NUMBER_OF_SAMPLES = 12;
+
+    explicit laneModelFilter(const int count = NUMBER_OF_PARTICLES);
+    ~laneModelFilter();
+
+    // edge and marker maps are distances to nearest feature (CV_32F, as
+    // particleFilter::getDistanceMap()), road is colour probability
+    // (particleFilter::getColorProbability()). Empty maps are skipped.
+    void measurementUpdate(const cv::Mat& edgeDistance, const cv::Mat& markerDistance,
+                           const cv::Mat& roadProbability);
+    // systematic resampling into the back buffer, then swap
+    void resample();
+    // random walk of every parameter with its process noise
+    void diffuse();
+    // carry every hypothesis along the lane: vehicle drove speed * interval
+    // meters and turned yawRate * interval radians (left positive), then
+    // diffuse(). Crossing a boundary re-centres on the neighbouring lane.
+    void predict(const float speed, const float yawRate, const float interval);
+    void setProcessNoise(const laneModel& noise) { processNoise = noise; }
+    void seed(const quint64 value);
+
+    // weighted mean of all hypotheses
+    laneModel getEstimate() const;
+    // image points of left and right boundary of a lane, near to far
+    void project(const laneModel& lane, std::vector<cv::Point>& left, std::vector<cv::Point>& right) const;
+    int getParticleCount() const { return particleCount; }
+
+  private:
+    laneModelFilter            (const laneModelFilter &);
+    laneModelFilter& operator= (const laneModelFilter &);
+
+    //structure of arrays, one array per lane parameter
+    struct laneSet
+    {
+      std::vector<float> offset;
+      std::vector<float> yaw;
+      std::vector<float> width;
+      std::vector<float> curvature;
+      std::vector<float> weight;
+
+      void resize(const int n);
+    };
+
+    void buildSamples();
+    void scatter();
+    float scoreDistance(const cv::Mat& distance, const int k) const;
+    float scoreRoad(const cv::Mat& road, const int k) const;
+
+    int particleCount;
+    laneSet lanes;
+    laneSet spare;
+
+    //sample i lies sampleDistance[i] meters ahead, on image row sampleRow[i].
+    //A road point Y meters left projects to column
+    //sampleColumn[i] - Y * sampleScale[i], so per particle projection is one
+    //multiply-add per sample.
+    float sampleDistance[NUMBER_OF_SAMPLES];
+    int sampleRow[NUMBER_OF_SAMPLES];
+    float sampleColumn[NUMBER_OF_SAMPLES];
+    float sampleScale[NUMBER_OF_SAMPLES];
+
+    //pixel distance likelihood of a boundary sample
+    likelihoodTable gaussian;
+    randomGenerator random;
+    //process noise of offset, yaw, width, curvature
+    laneModel processNoise;
+};
+
+#endif  //NAVPRO_LANE_MODEL_FILTER_H_
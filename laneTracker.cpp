@@ -15,125 +15,209 @@
 #include <QtDebug>
 #include "laneTracker.h"
 
+void laneTracker::workspace::create(const int width, const int height)
+{
+  edgeBlur.create(height, width, CV_8UC1);
+  edges.create(height, width, CV_8UC1);
+  edgeColor.create(height, width, CV_8UC3);
+  edgeRGB.create(height, width, CV_8UC3);
+  markerBlur.create(height, width, CV_8UC1);
+  marker.create(height, width, CV_8UC1);
+
+  //pyrDown() rounds odd sizes up
+  int w = width, h = height;
+  for (int l = 0; l < PYRAMID_LEVELS; ++l)
+  {
+    w = (w + 1) / 2;
+    h = (h + 1) / 2;
+    pyramid[l].create(h, w, CV_8UC1);
+  }
+  coarseEdges.create(h, w, CV_8UC1);
+  coarseMarker.create(h, w, CV_8UC1);
+}
+
 laneTracker::laneTracker()
+  : pyramidCues_(0),
+    pyramidReady_(false),
+    globalSearch_(true),
+    coarseFrames_(0),
+    reallocations_(0)
 {
   try{
-    pHistVector_ = new std::vector<cv::Mat>;
+    src_.create(FRAME_HEIGHT, FRAME_WIDTH, CV_8UC3);
+    gray_.create(FRAME_HEIGHT, FRAME_WIDTH, CV_8UC1);
+    ws_.create(FRAME_WIDTH, FRAME_HEIGHT);
+    blur_ = cv::createGaussianFilter(CV_8UC1, cv::Size(5,5), 0, 0);
   }
   catch(std::bad_alloc& ba)
   {
     std::cerr<<"alloc failed: "<<ba.what()<<std::endl;
   }
+  catch(cv::Exception& e)
+  {
+    std::cerr<<"alloc failed: "<<e.what()<<std::endl;
+  }
+
+  //1-D LoG kernel centred on tap MARKER_KERNEL_SIZE/2
+  float k[MARKER_KERNEL_SIZE];
+  for (int i = 0, j = -(MARKER_KERNEL_SIZE/2); i < MARKER_KERNEL_SIZE; ++i, ++j)
+    k[i] = LoG(j);
+  markerFilter_.build(k);
+
+  //coarse pixel spans COARSE_SCALE full ones, so each tap stands for
+  //COARSE_SCALE samples of the full kernel
+  float coarseKernel[COARSE_MARKER_KERNEL_SIZE];
+  for (int i = 0, j = -(COARSE_MARKER_KERNEL_SIZE/2); i < COARSE_MARKER_KERNEL_SIZE; ++i, ++j)
+    coarseKernel[i] = COARSE_SCALE * LoG(j * COARSE_SCALE);
+  coarseMarkerFilter_.build(coarseKernel);
+
+  for (int i = 0; i < NUMBER_OF_BUFFERS; ++i)
+    bufferData_[i] = NULL;
+  countReallocations();
+  reallocations_ = 0;
 }
 
 laneTracker::~laneTracker()
 {
-  delete pHistVector_;
 }
 
-int laneTracker::preprocess(const char* path)
+// compare every buffer with where it was when last frame started, OpenCV
+// create() moves a buffer only when it has to reallocate it
+void laneTracker::countReallocations()
+{
+  const cv::Mat* buffers[NUMBER_OF_BUFFERS] = {
+    &src_, &gray_,
+    &ws_.edgeBlur, &ws_.edges, &ws_.edgeColor, &ws_.edgeRGB,
+    &ws_.markerBlur, &ws_.marker,
+    &ws_.pyramid[0], &ws_.pyramid[1],
+    &ws_.coarseEdges, &ws_.coarseMarker
+  };
+  for (int i = 0; i < NUMBER_OF_BUFFERS; ++i)
+  {
+    if (buffers[i]->data != bufferData_[i])
+    {
+      ++reallocations_;
+      bufferData_[i] = buffers[i]->data;
+    }
+  }
+}
+
+int laneTracker::preprocess(const videoFrame& frame)
 {
-  cv::Mat dstRGB;
-  src_ = cv::imread(path);
-  if (!src_.data)
+  countReallocations();
+  pyramidReady_ = false;
+
+  if (frame.isNull())
   {
     std::cerr<<"src image NULL Error!";
     return -1;
   }
 
-  cv::resize(src_, src_, cv::Size(FRAME_WIDTH, FRAME_HEIGHT));
+  //BGRA, BGR or gray view of the decoded frame, no copy
+  cv::Mat in = frame.mat();
+  if (in.cols != FRAME_WIDTH || in.rows != FRAME_HEIGHT)
+  {
+    cv::resize(in, resized_, cv::Size(FRAME_WIDTH, FRAME_HEIGHT));
+    in = resized_;
+  }
 
-  std::cout<<"image size:"<<src_.size()<<" type:"<<src_.type()<<std::endl;
+  //into the preallocated frames, never in place. A gray frame has no
+  //chroma, the colour model then sees gray road.
+  if (in.channels() == 4)
+  {
+    cvtColor(in, src_, CV_BGRA2BGR);
+    cvtColor(in, gray_, CV_BGRA2GRAY);
+  }
+  else if (in.channels() == 3)
+  {
+    in.copyTo(src_);
+    cvtColor(in, gray_, CV_BGR2GRAY);
+  }
+  else
+  {
+    in.copyTo(gray_);
+    cvtColor(in, src_, CV_GRAY2BGR);
+  }
 
-  cvtColor(src_, gray_, CV_BGR2GRAY);
+  std::cout<<"image size:"<<src_.size()<<" type:"<<src_.type()<<std::endl;
 
   return 0;
 }
 
-std::vector<cv::Mat>* laneTracker::roadColorDetect()
+// part of roi inside fallback, fallback itself when there is no roi or
+// they don't overlap
+cv::Rect laneTracker::region(const cv::Rect& fallback) const
 {
-  //Rect(x, y ,width, height)
-  //Rect roi(0, src_.rows/2, src_.cols, src_.rows/2);  
-
-  //TODO dynamicly adjust road_rect
-  cv::Mat roadRegion = src_(ROAD_RECT(src_.cols, src_.rows));
-
-  cv::Mat ycrcb;
-  cvtColor(roadRegion, ycrcb, CV_BGR2YCrCb);
-
-  /// Separate the image in 3 places ( B, G and R )
-  std::vector<cv::Mat> bgr_planes;
-  split(roadRegion, bgr_planes);
-
-  std::vector<cv::Mat> ycbcr_planes;
-  split(ycrcb, ycbcr_planes);
-
-  /// Establish the number of bins, x-axis
-  int histSize = 256;
-
-  /// Set the ranges ( for B,G,R) )
-  float range[] = { 0, 256 } ;
-  const float* histRange = { range };
-
-  bool uniform = true; bool accumulate = false;
-
-  cv::Mat b_hist, g_hist, r_hist;
-  cv::Mat b_blur, g_blur, r_blur;
-
-  cv::Mat y_hist, cr_hist, cb_hist;
-  cv::Mat y_blur, cr_blur, cb_blur;
-
-  GaussianBlur(bgr_planes[0], b_blur, cv::Size(5,5), 0, 0);
-  GaussianBlur(bgr_planes[1], g_blur, cv::Size(5,5), 0, 0);
-  GaussianBlur(bgr_planes[2], r_blur, cv::Size(5,5), 0, 0);
-
-  GaussianBlur(ycbcr_planes[0], y_blur, cv::Size(5,5), 0, 0);
-  GaussianBlur(ycbcr_planes[1], cr_blur, cv::Size(5,5), 0, 0);
-  GaussianBlur(ycbcr_planes[2], cb_blur, cv::Size(5,5), 0, 0);
-  /// Compute the histograms:
-  calcHist( &b_blur, 1, 0, cv::Mat(), b_hist, 1, &histSize, &histRange, uniform, accumulate );
-  calcHist( &g_blur, 1, 0, cv::Mat(), g_hist, 1, &histSize, &histRange, uniform, accumulate );
-  calcHist( &r_blur, 1, 0, cv::Mat(), r_hist, 1, &histSize, &histRange, uniform, accumulate );
+  cv::Rect area = roi_ & fallback;
+  if (area.area() <= 0)
+    return fallback;
+  return area;
+}
 
-  calcHist( &y_blur, 1, 0, cv::Mat(), y_hist, 1, &histSize, &histRange, uniform, accumulate );
-  calcHist( &cr_blur, 1, 0, cv::Mat(), cr_hist, 1, &histSize, &histRange, uniform, accumulate );
-  calcHist( &cb_blur, 1, 0, cv::Mat(), cb_hist, 1, &histSize, &histRange, uniform, accumulate );
+const roadColorModel& laneTracker::roadColorDetect()
+{
+  //Rect(x, y ,width, height)
+  //road rect is narrowed to roi while particles track the road, and to
+  //road mask pixels when one is set
+  cv::Rect area = region(ROAD_RECT(src_.cols, src_.rows));
+  colorModel_.update(src_, area, roadMask_);
+  VERBOSE_LOG("road colour samples:"<<colorModel_.getSampleCount());
+  return colorModel_;
+}
 
-  /// Normalize the result to [ 0, 100 ], percentage representation,, y-axis
-  // for example, there are N blue pixels at 150 [0, 255], and N is the max
-  // from [0, 255], then N is max of the range:100
-  normalize(b_hist, b_hist, 0, 100, cv::NORM_MINMAX, -1, cv::Mat() );
-  normalize(g_hist, g_hist, 0, 100, cv::NORM_MINMAX, -1, cv::Mat() );
-  normalize(r_hist, r_hist, 0, 100, cv::NORM_MINMAX, -1, cv::Mat() );
+void laneTracker::setPyramidCues(const int cues)
+{
+  Q_ASSERT((cues & ~PYRAMID_CUES) == 0);
+  pyramidCues_ = cues & PYRAMID_CUES;
+}
 
-  normalize(y_hist, y_hist, 0, 100, cv::NORM_MINMAX, -1, cv::Mat() );
-  normalize(cr_hist, cr_hist, 0, 100, cv::NORM_MINMAX, -1, cv::Mat() );
-  normalize(cb_hist, cb_hist, 0, 100, cv::NORM_MINMAX, -1, cv::Mat() );
+// cue runs on coarse level this frame
+bool laneTracker::coarse(const int cue) const
+{
+  return (pyramidCues_ & cue) && globalSearch_;
+}
 
-  // clear vector first
-  pHistVector_->clear();
-  pHistVector_->push_back(cr_hist);
-  pHistVector_->push_back(cb_hist);
-  return pHistVector_;
+void laneTracker::detect(const int requests)
+{
+  if (coarse(requests & PYRAMID_CUES))
+    ++coarseFrames_;
+  if (requests & (EDGE_MASK | EDGE_IMAGE))
+    edgeMask_ = coarse(EDGE_MASK) ? coarseEdgeDetect() : edgeDetect();
+  if (requests & EDGE_IMAGE)
+    edgeImage_ = edgeImage();
+  if (requests & MARKER_RESPONSE)
+    markerResponse_ = coarse(MARKER_RESPONSE) ? coarseMarkerDetect() : laneMarkerDetect();
+  if (requests & ROAD_COLOR_MODEL)
+    roadColorDetect();
 }
 
 cv::Mat laneTracker::edgeDetect()
 {
-  cv::Mat edges, dstRGB;
+  cv::Rect area = region(cv::Rect(0, 0, gray_.cols, gray_.rows));
+  cv::Mat blur = ws_.edgeBlur(area);
+  cv::Mat edges = ws_.edges(area);
 
-  GaussianBlur(gray_, edges, cv::Size(5,5), 0, 0);
+  blur_->apply(gray_(area), blur);
 
   int lowThreshold = 100;
   int ratio = 3;
   int kernel_size = 3;
-  Canny(edges, edges, lowThreshold, lowThreshold*ratio, kernel_size);
-  cv::Mat dst;
-  dst = cv::Scalar::all(0);
+  // no edge outside roi
+  ws_.edges.setTo(cv::Scalar::all(0));
+  Canny(blur, edges, lowThreshold, lowThreshold*ratio, kernel_size);
+
+  return ws_.edges;
+}
+
+cv::Mat laneTracker::edgeImage()
+{
+  ws_.edgeColor.setTo(cv::Scalar::all(0));
 
   //! copies "src" elements to "dst" that are marked with non-zero "edges" elements.
-  src_.copyTo(dst, edges);
+  src_.copyTo(ws_.edgeColor, ws_.edges);
 
-  cvtColor(dst,dstRGB, CV_BGR2RGB);
+  cv::Mat dstRGB = ws_.edgeRGB;
+  cvtColor(ws_.edgeColor, dstRGB, CV_BGR2RGB);
 
   std::cout<<"edge image size:"<<dstRGB.size()<<" type:"<<dstRGB.type()<<std::endl;
   return dstRGB;
@@ -157,57 +241,95 @@ cv::Mat laneTracker::cvLaplicain()
 
 cv::Mat laneTracker::laneMarkerDetect()
 {
-  int kernel_size = 11;
-  float k[kernel_size] ;
-
-  //calc 1-D kernel;
-  int i,j;
-  for(i = 0, j = -(kernel_size/2); i <= kernel_size; ++i, ++j)
-  {
-      k[i] = LoG(j);
-      //std::cout<<" k["<<j<<"]: "<<k[i];
-  }
-  //std::cout<<std::endl;
-
-  cv::Mat src, dst;
-  cv::Mat roadRegion = gray_(ROAD_RECT(gray_.cols, gray_.rows));
+  cv::Rect area = region(ROAD_RECT(gray_.cols, gray_.rows));
+  cv::Mat roadRegion = gray_(area);
   // blur gray source image
-  // src region only has down-half size of origin gray image
-  GaussianBlur(roadRegion, src, cv::Size(5,5), 0, 0);
+  // src region only has roi or down-half size of origin gray image
+  cv::Mat src = ws_.markerBlur(area);
+  blur_->apply(roadRegion, src);
 
   // dst has same size as origin gray image
-  dst.create(gray_.size(), CV_MAKETYPE(CV_8U, src.channels()));
-  dst = cv::Scalar::all(0);
+  cv::Mat dst = ws_.marker;
+  dst.setTo(cv::Scalar::all(0));
 
-  uchar *src_row, *src_pos_in_row, *dst_row;
-  
-  // so far, size of Mats are (if image w = 1, h = 1):
+  // so far, size of Mats are (if image w = 1, h = 1, no roi):
   // gray_      (1, 1)
   // roadRegion (1, 1/2)
   // src        (1, 1/2)
   // dst        (1, 1)
-  std::cout<<"dst size: "<<dst.size()<<" cols:"<<dst.cols<<" rows:"<<dst.rows<<std::endl;
-  std::cout<<"src size: "<<src.size()<<" cols:"<<src.cols<<" rows:"<<src.rows<<std::endl;
-  float sum_f;
-  // y-th for dst and src
-  int yd,ys;
-  for(yd = gray_.rows - src.rows, ys = 0; yd < gray_.rows; ++yd, ++ys)
+  // with roi, roadRegion and src are area, placed at area.tl() of dst.
+  // Columns within kernel radius of area's sides stay 0, pixels outside
+  // area were not blurred this frame.
+  for (int ys = 0; ys < src.rows; ++ys)
+    markerFilter_.apply(src.ptr(ys), dst.ptr(area.y + ys) + area.x, src.cols);
+
+  return dst;
+}
+
+// gray_ down to 1/COARSE_SCALE, once per frame
+void laneTracker::buildPyramid()
+{
+  if (pyramidReady_)
+    return;
+  cv::pyrDown(gray_, ws_.pyramid[0], ws_.pyramid[0].size());
+  for (int l = 1; l < PYRAMID_LEVELS; ++l)
+    cv::pyrDown(ws_.pyramid[l - 1], ws_.pyramid[l], ws_.pyramid[l].size());
+  pyramidReady_ = true;
+}
+
+// non-zero pixels of coarse, whose frame is area of the coarse level, to
+// the centre of their block in full. Everything else in full is cleared.
+void laneTracker::scatterUp(const cv::Mat& coarse, const cv::Rect& area, cv::Mat& full)
+{
+  full.setTo(cv::Scalar::all(0));
+  const int half = COARSE_SCALE / 2;
+  const uchar* in;
+  uchar* out;
+  int x, y, xf;
+  for (y = 0; y < coarse.rows; ++y)
   {
-      // get pointer to y-th row
-      src_row = src.ptr(ys); 
-      dst_row = dst.ptr(yd); 
-      for(int x = gray_.cols - src.cols; x < src.cols - kernel_size/2; ++x)
-      {
-          sum_f = 0.0;
-          src_pos_in_row = src_row + x;
-          for (int kx = 0; kx < kernel_size; ++kx)
-          {
-              sum_f += *(src_pos_in_row++) * k[kx];
-          }
-          *(dst_row + x + kernel_size/2) = static_cast<int>(sum_f);
-      }
+    const int yf = (area.y + y) * COARSE_SCALE + half;
+    if (yf >= full.rows)
+      break;
+    in = coarse.ptr(y);
+    out = full.ptr(yf);
+    for (x = 0; x < coarse.cols; ++x)
+    {
+      xf = (area.x + x) * COARSE_SCALE + half;
+      if (in[x] && xf < full.cols)
+        out[xf] = in[x];
+    }
   }
+}
 
-  return dst;
+// Canny on coarse level, pyrDown() already smoothed it so there is no blur
+cv::Mat laneTracker::coarseEdgeDetect()
+{
+  buildPyramid();
+  const cv::Mat& level = ws_.pyramid[PYRAMID_LEVELS - 1];
+
+  int lowThreshold = 100;
+  int ratio = 3;
+  int kernel_size = 3;
+  Canny(level, ws_.coarseEdges, lowThreshold, lowThreshold*ratio, kernel_size);
+
+  scatterUp(ws_.coarseEdges, cv::Rect(0, 0, level.cols, level.rows), ws_.edges);
+  return ws_.edges;
 }
 
+// LoG row filter over road rect of coarse level
+cv::Mat laneTracker::coarseMarkerDetect()
+{
+  buildPyramid();
+  const cv::Mat& level = ws_.pyramid[PYRAMID_LEVELS - 1];
+  cv::Rect area = ROAD_RECT(level.cols, level.rows);
+
+  //columns within kernel radius of the sides stay 0
+  cv::Mat dst = ws_.coarseMarker(area);
+  dst.setTo(cv::Scalar::all(0));
+  for (int ys = 0; ys < area.height; ++ys)
+    coarseMarkerFilter_.apply(level.ptr(area.y + ys) + area.x, dst.ptr(ys), area.width);
+
+  scatterUp(dst, area, ws_.marker);
+  return ws_.marker;
+}
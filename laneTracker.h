@@ -21,22 +21,143 @@
 #include <opencv2/highgui/highgui.hpp>
 //#include "cueBase.h"
 #include "particleFilter.h"
+#include "roadColorModel.h"
+#include "rowFilter.h"
+#include "videoFrame.h"
 #include <iostream>
 
 class laneTracker 
 {
 public:
+  // cue outputs a caller can ask detect() for, or-ed together
+  enum {
+    // binary Canny mask, CV_8UC1
+    EDGE_MASK = 0x01,
+    // source colours under edge mask as RGB, display only
+    EDGE_IMAGE = 0x02,
+    // LoG lane marker response, CV_8UC1
+    MARKER_RESPONSE = 0x04,
+    // road colour model folded with road region
+    ROAD_COLOR_MODEL = 0x08,
+    ALL_CUES = EDGE_MASK | EDGE_IMAGE | MARKER_RESPONSE | ROAD_COLOR_MODEL,
+    // cues setPyramidCues() accepts
+    PYRAMID_CUES = EDGE_MASK | MARKER_RESPONSE
+  };
+
+  // pyramid levels below full frame, coarse cues run at 1/COARSE_SCALE
+  const static int PYRAMID_LEVELS = 2;
+  const static int COARSE_SCALE = 1 << PYRAMID_LEVELS;
+
   laneTracker();
   ~laneTracker();
 
-  int preprocess (const char* path);
+  // colour and gray working images of frame, resized only when frame
+  // isn't FRAME_WIDTH x FRAME_HEIGHT
+  int preprocess (const videoFrame& frame);
+  // run only stages the requested outputs need, on frame of last
+  // preprocess(). Outputs not requested keep whatever they held.
+  void detect (const int requests);
+  const cv::Mat& getEdgeMask() const { return edgeMask_; }
+  const cv::Mat& getEdgeImage() const { return edgeImage_; }
+  const cv::Mat& getMarkerResponse() const { return markerResponse_; }
+
+  // single stages detect() runs
   cv::Mat edgeDetect ();
-  std::vector<cv::Mat>* roadColorDetect ();
+  // colours under mask of last edgeDetect()
+  cv::Mat edgeImage ();
+  const roadColorModel& roadColorDetect ();
   cv::Mat laneMarkerDetect ();
+  // compute cues only inside roi, empty rect falls back to full frame
+  // (edges) and ROAD_RECT (marker, colour)
+  void setRoi(const cv::Rect& roi) { roi_ = roi; }
+  // pixels believed to be road (non-zero, CV_8UC1 of frame size), the
+  // colour model samples only these. Empty mat samples the whole region.
+  void setRoadMask(const cv::Mat& mask) { roadMask_ = mask; }
+  // coarse-to-fine cues, subset of PYRAMID_CUES. During global search
+  // they run on the 1/COARSE_SCALE pyramid level; once hypotheses survive
+  // and tracking resumes, at full resolution inside roi.
+  // Outputs are frame size either way, a coarse feature lands on the
+  // centre pixel of its block. 0, the default, is full resolution always.
+  void setPyramidCues(const int cues);
+  int getPyramidCues() const { return pyramidCues_; }
+  // no track to follow, cues search the whole frame (coarse when pyramid
+  // cues are set). On until the caller reports a track.
+  void setGlobalSearch(const bool on) { globalSearch_ = on; }
+  bool isGlobalSearch() const { return globalSearch_; }
+  // frames detect() ran at least one cue on the coarse level
+  int getCoarseFrames() const { return coarseFrames_; }
+  roadColorModel& getColorModel() { return colorModel_; }
+  const cv::Rect& getRoi() const { return roi_; }
+  // times a workspace buffer was found moved at the start of a frame, stays
+  // 0 once frames run at FRAME_WIDTH x FRAME_HEIGHT. Only sees workspace
+  // Mats; tools/bench/alloc counts every allocation of a frame and fails
+  // when preprocess allocates. Canny() and distanceTransform() still
+  // allocate scratch inside OpenCV.
+  int getReallocations() const { return reallocations_; }
 private:
+  // every intermediate buffer of one frame, allocated once for
+  // FRAME_WIDTH x FRAME_HEIGHT. Stages restricted to a region write into
+  // the same region of a full frame buffer, so roi changes don't reallocate
+  // either. Mats handed out by the detectors share these buffers and are
+  // valid until next call.
+  struct workspace
+  {
+    //gray blurred for edges, Canny output, source masked by edges
+    cv::Mat edgeBlur;
+    cv::Mat edges;
+    cv::Mat edgeColor;
+    cv::Mat edgeRGB;
+    //lane marker
+    cv::Mat markerBlur;
+    cv::Mat marker;
+    //gray at 1/2 and 1/COARSE_SCALE, Canny and marker of coarse level
+    cv::Mat pyramid[PYRAMID_LEVELS];
+    cv::Mat coarseEdges;
+    cv::Mat coarseMarker;
+
+    void create(const int width, const int height);
+  };
+
+  //taps of LoG row filter of laneMarkerDetect()
+  const static int MARKER_KERNEL_SIZE = 11;
+  //same LoG sampled every COARSE_SCALE pixels
+  const static int COARSE_MARKER_KERNEL_SIZE = 3;
+  //workspace buffers plus source and gray
+  const static int NUMBER_OF_BUFFERS = 8 + PYRAMID_LEVELS + 2;
+
+  cv::Rect region(const cv::Rect& fallback) const;
+  bool coarse(const int cue) const;
+  void buildPyramid();
+  cv::Mat coarseEdgeDetect();
+  cv::Mat coarseMarkerDetect();
+  static void scatterUp(const cv::Mat& coarse, const cv::Rect& area, cv::Mat& full);
+  void countReallocations();
   cv::Mat cvLaplicain();
+  //frame resized to working resolution, when it comes in another size
+  cv::Mat resized_;
   cv::Mat src_;
   cv::Mat gray_;
-  std::vector<cv::Mat>* pHistVector_;
+  workspace ws_;
+  //5x5 Gaussian of edge and marker stages. GaussianBlur() builds one
+  //per call, with its row buffers; this one keeps them between frames.
+  cv::Ptr<cv::FilterEngine> blur_;
+  rowFilter<MARKER_KERNEL_SIZE> markerFilter_;
+  rowFilter<COARSE_MARKER_KERNEL_SIZE> coarseMarkerFilter_;
+  int pyramidCues_;
+  //pyramid holds current frame
+  bool pyramidReady_;
+  bool globalSearch_;
+  int coarseFrames_;
+  //buffer data pointers when last frame started
+  const uchar* bufferData_[NUMBER_OF_BUFFERS];
+  int reallocations_;
+  //persistent joint CrCb road histogram
+  roadColorModel colorModel_;
+  cv::Mat roadMask_;
+  cv::Rect roi_;
+  //last detect() outputs, share workspace buffers
+  cv::Mat edgeMask_;
+  cv::Mat edgeImage_;
+  cv::Mat markerResponse_;
 };
 #endif //NAVPRO_LANETRACKER_H_
@@ -0,0 +1,73 @@
+/*=============================================================================
+**                            MODULE SPECIFICATION
+===============================================================================
+**
+**  Title : Gaussian likelihood lookup table
+**
+**  Description : Tabulates Gaussian(d, sigma, 0) for integer distance d, so
+**                a cue that measures pixel distance pays one indexed load
+**                instead of pow/exp/sqrt. Rebuild only when sigma changes.
+**
+**
+===============================================================================
+**  Author            :     Xin Zhang
+**  Creation Date     :     2013.06.02
+===============================================================================
+**/
+
+#ifndef NAVPRO_LIKELIHOOD_TABLE_H_
+#define NAVPRO_LIKELIHOOD_TABLE_H_
+
+#include <vector>
+#include <QtGlobal>
+
+#include "environment.h"
+
+class likelihoodTable
+{
+  public:
+    likelihoodTable()
+      : sigma_(0.0)
+    {
+    }
+
+    // tabulate distances [0, size), does nothing if already built for them
+    void build(const float sigma, const int size)
+    {
+        Q_ASSERT(sigma > 0.0 && size > 0);
+        if (sigma == sigma_ && size <= static_cast<int>(table_.size()))
+          return;
+
+        sigma_ = sigma;
+        table_.resize(qMax(size, static_cast<int>(table_.size())));
+        logTable_.resize(table_.size());
+        const double logNorm = log(sigma_ * sqrt(2.0 * PI));
+        for(int d = 0; d < static_cast<int>(table_.size()); ++d)
+        {
+            //same float the Gaussian() macro gives when assigned to float
+            table_[d] = Gaussian(d, sigma_, 0);
+            //closed form, stays finite where table_[d] underflows to 0
+            logTable_[d] = -(static_cast<double>(d) * d) / (2.0 * sigma_ * sigma_) - logNorm;
+        }
+    }
+
+    float sigma() const { return sigma_; }
+    int size() const { return static_cast<int>(table_.size()); }
+    // raw table for hot loops that already keep distance within size()
+    const float* data() const { return &table_[0]; }
+    // log likelihood, for cues fused as weighted log-sums
+    const float* logData() const { return &logTable_[0]; }
+
+    // distances past the table get the last, smallest, likelihood
+    float operator[] (const int dist) const
+    {
+        return table_[qMin(dist, size() - 1)];
+    }
+
+  private:
+    float sigma_;
+    std::vector<float> table_;
+    std::vector<float> logTable_;
+};
+
+#endif  //NAVPRO_LIKELIHOOD_TABLE_H_
@@ -29,13 +29,42 @@ int main(int argc, char *argv[])
 {
     QApplication a(argc, argv);
 
+    //first argument that isn't an option names the frame source: a JPEG
+    //directory, a video file, or a raw *.bgr / *.yuv dump
     QString path = QString("road/");
+    for (int i = 1; i < a.arguments().size(); ++i)
+    {
+        if (!a.arguments()[i].startsWith("--"))
+        {
+            path = a.arguments()[i];
+            break;
+        }
+    }
+
+    //--verbose prints per-frame diagnostics
+    verboseLog() = a.arguments().contains("--verbose");
 
     //opencv image processing class
     laneTracker tracker;
     inputManager input(path);
+    //--pyramid searches edges and lane markers on a coarse level until
+    //the particles hold a track
+    if (a.arguments().contains("--pyramid"))
+      tracker.setPyramidCues(laneTracker::PYRAMID_CUES);
 
-    navproCore core(&tracker, &input);
+    //--per-cue runs one filter per cue instead of the fused one
+    int filterMode = a.arguments().contains("--per-cue") ?
+                     navproCore::PER_CUE_FILTERS : navproCore::FUSED_FILTER;
+    //--headless tracks every image once and skips all display work
+    bool headless = a.arguments().contains("--headless");
+    navproCore core(&tracker, &input, filterMode, !headless);
+    if (headless)
+    {
+        while (core.move())
+          ;
+        core.logSummary();
+        return 0;
+    }
 
     //main window should know core for display
     mainwindow window(&core);
@@ -43,5 +72,7 @@ int main(int argc, char *argv[])
     //core.probe();
     window.show();
     //core.show();
-    return a.exec();
+    int result = a.exec();
+    core.logSummary();
+    return result;
 }
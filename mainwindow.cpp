@@ -99,31 +99,37 @@ void mainwindow::widgetParticle::paintEvent(QPaintEvent *event)
 
     (void)event;
 
-    const M_Prob *prob = p_parent_->getParticles(particleFilter::EDGE);
-    assert(prob);
-    paintParticles(prob, EDGE_OFFSET_X, EDGE_OFFSET_Y);
+    const particleFilter *filter = p_parent_->getFilter(particleFilter::EDGE);
+    assert(filter);
+    paintParticles(filter, EDGE_OFFSET_X, EDGE_OFFSET_Y);
 
-    prob = p_parent_->getParticles(particleFilter::LANE_MARKER);
-    assert(prob);
-    paintParticles(prob, MARKER_OFFSET_X, MARKER_OFFSET_Y);
+    filter = p_parent_->getFilter(particleFilter::LANE_MARKER);
+    assert(filter);
+    paintParticles(filter, MARKER_OFFSET_X, MARKER_OFFSET_Y);
 
-    prob = p_parent_->getParticles(particleFilter::COLOR);
-    assert(prob);
-    paintParticles(prob, COLOR_OFFSET_X, COLOR_OFFSET_Y);
+    filter = p_parent_->getFilter(particleFilter::COLOR);
+    assert(filter);
+    paintParticles(filter, COLOR_OFFSET_X, COLOR_OFFSET_Y);
+
+    const laneModelFilter* lane = p_parent_->getLaneFilter();
+    assert(lane);
+    paintLane(lane, ORIGIN_OFFSET_X, ORIGIN_OFFSET_Y);
 }
 
-void mainwindow::widgetParticle::paintParticles(const M_Prob* prob, int offset_x, int offset_y)
+void mainwindow::widgetParticle::paintParticles(const particleFilter* filter, int offset_x, int offset_y)
 {
     QPainter painter(this);
     painter.setPen(QPen(Qt::black, 1));
     painter.setBrush(QBrush(Qt::red));
  
     //map particle (640x480) to display(400x300)
+    const particleSet* prob = filter->getParticles();
     int particle_x, particle_y, ui_x, ui_y;
-    for(int i = 0; i < particleFilter::NUMBER_OF_PARTICLES; ++i)
+    //particle count changes frame to frame when filter is adaptive
+    for(int i = 0; i < filter->getParticleCount(); ++i)
     {
-        particle_x = prob[i].x;
-        particle_y = prob[i].y;
+        particle_x = prob->x[i];
+        particle_y = prob->y[i];
         std::cout<<"i:"<<i<<" x:"<<particle_x<<" y:"<<particle_y<<std::endl;
         ui_x = particle_x * static_cast<double>(WIDTH)/FRAME_WIDTH;
         ui_y = particle_y * static_cast<double>(HEIGHT)/FRAME_HEIGHT;
@@ -131,4 +137,30 @@ void mainwindow::widgetParticle::paintParticles(const M_Prob* prob, int offset_x
         //draw ellipse on origin image
         painter.drawEllipse(QPoint(ui_x + offset_x, ui_y + offset_y), 1, 1);
     }
+
+    //weight health of last update in pane's top left corner
+    const filterHealth& health = filter->getHealth();
+    painter.drawText(offset_x + 5, offset_y + 15,
+                     QString("ESS ") + QString::number(health.ess) +
+                     QString(" max ") + QString::number(health.maxWeight) +
+                     QString(" H ") + QString::number(health.entropy));
+}
+
+void mainwindow::widgetParticle::paintLane(const laneModelFilter* filter, int offset_x, int offset_y)
+{
+    QPainter painter(this);
+    painter.setPen(QPen(Qt::green, 2));
+
+    //estimated boundaries as polylines through projected samples
+    std::vector<cv::Point> left, right;
+    filter->project(filter->getEstimate(), left, right);
+    const double scale_x = static_cast<double>(WIDTH)/FRAME_WIDTH;
+    const double scale_y = static_cast<double>(HEIGHT)/FRAME_HEIGHT;
+    for(size_t i = 1; i < left.size(); ++i)
+    {
+        painter.drawLine(QPoint(left[i-1].x * scale_x + offset_x, left[i-1].y * scale_y + offset_y),
+                         QPoint(left[i].x * scale_x + offset_x, left[i].y * scale_y + offset_y));
+        painter.drawLine(QPoint(right[i-1].x * scale_x + offset_x, right[i-1].y * scale_y + offset_y),
+                         QPoint(right[i].x * scale_x + offset_x, right[i].y * scale_y + offset_y));
+    }
 }
@@ -23,6 +23,7 @@
 #include <QWidget>
 #include "navproCore.h"
 #include "particleFilter.h"
+#include "laneModelFilter.h"
 
 namespace Ui {
 class MainWindow;
@@ -45,6 +46,10 @@ class mainwindow : public QWidget
     const static int MARKER_OFFSET_X = 400;
     const static int MARKER_OFFSET_Y = 300;
 
+    //origin display offset from mainwindow(0,0)
+    const static int ORIGIN_OFFSET_X = 0;
+    const static int ORIGIN_OFFSET_Y = 0;
+
     //color display offset from mainwindow(0,0)
     const static int COLOR_OFFSET_X = 0;
     const static int COLOR_OFFSET_Y = 300;
@@ -53,7 +58,8 @@ public:
     mainwindow(navproCore *core, QWidget *parent = 0);
     ~mainwindow();
 
-    const M_Prob* getParticles(int type){ return p_Core_->getParticles(type);}
+    const particleFilter* getFilter(int type){ return p_Core_->getFilter(type);}
+    const laneModelFilter* getLaneFilter(){ return p_Core_->getLaneFilter();}
     
 protected:
     void keyPressEvent(QKeyEvent * e);
@@ -67,7 +73,8 @@ private:
       protected:
         void paintEvent(QPaintEvent *event);
       private:
-        void paintParticles(const M_Prob* prob, int offset_x, int offset_y);
+        void paintParticles(const particleFilter* filter, int offset_x, int offset_y);
+        void paintLane(const laneModelFilter* filter, int offset_x, int offset_y);
         mainwindow *p_parent_;
     };
     void updateUi();
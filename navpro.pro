@@ -10,18 +10,30 @@ QMAKE_CFLAGS += -Werror
 #RESOURCES += navpro.qrc
 HEADERS += eulerTransformer.h \
            coordinateSystems.h \
+           frameSource.h \
+           laneModelFilter.h \
            laneTracker.h \
            inputManager.h \
+           likelihoodTable.h \
+           packedFrames.h \
            particleFilter.h \
            pinholeTransformer.h \
+           randomGenerator.h \
+           roadColorModel.h \
+           rowFilter.h \
+           videoFrame.h \
            point.h \
            navproCore.h \
            mainwindow.h
 SOURCES += main.cpp \
            eulerTransformer.cpp \
+           frameSource.cpp \
+           packedFrames.cpp \
+           laneModelFilter.cpp \
            laneTracker.cpp \
            inputManager.cpp \
            particleFilter.cpp \
+           roadColorModel.cpp \
            navproCore.cpp \
            mainwindow.cpp
 FORMS += mainwindow.ui
@@ -30,13 +30,43 @@
                 CV_IMAGE.cols, CV_IMAGE.rows, \
                 QImage::Format_Indexed8))
 
-navproCore::navproCore(laneTracker* tracker, inputManager* input):
+//one log line per filter and frame, weights as measured, call it before
+//resample() refills them uniform
+static void logHealth(const particleFilter* filter)
+{
+    const filterHealth& health = filter->getHealth();
+    VERBOSE_LOG("particles:"<<filter->getParticleCount()
+                <<" ess:"<<health.ess
+                <<" max weight:"<<health.maxWeight
+                <<" entropy:"<<health.entropy
+                <<" resample:"<<filter->resampleDue()
+                <<" lost:"<<health.lost);
+}
+
+//one log line per frame, how far decoding runs ahead of processing
+static void logPrefetch(const inputManager* input)
+{
+    const prefetchStats stats = input->getPrefetchStats();
+    VERBOSE_LOG("frames ready:"<<stats.ready<<"/"<<stats.depth
+                <<" decode workers:"<<stats.workers
+                <<" decode ms mean:"<<stats.meanDecode
+                <<" max:"<<stats.maxDecode
+                <<" stalls:"<<stats.stalls
+                <<" wait ms mean:"<<stats.meanWait);
+}
+
+navproCore::navproCore(laneTracker* tracker, inputManager* input, const int filterMode,
+                       const bool display):
     pTracker(tracker),
     p_input_manager_(input),
-    p_histogram_(NULL),
+    p_color_model_(NULL),
+    filter_mode_(filterMode),
+    display_(display),
     p_particle_edge_(NULL),
     p_particle_marker_(NULL),
     p_particle_color_(NULL),
+    p_particle_fused_(NULL),
+    p_lane_filter_(NULL),
     p_image_origin_(NULL),
     p_image_edge_(NULL),
     p_image_marker_(NULL),
@@ -49,9 +79,17 @@ navproCore::navproCore(laneTracker* tracker, inputManager* input):
         p_image_marker_ = new QImage();
         p_image_color_ = new QImage();
 
-        p_particle_edge_ = new particleFilter();
-        p_particle_marker_ = new particleFilter();
-        p_particle_color_ = new particleFilter();
+        if (filter_mode_ == FUSED_FILTER)
+        {
+            p_particle_fused_ = new particleFilter();
+        }
+        else
+        {
+            p_particle_edge_ = new particleFilter();
+            p_particle_marker_ = new particleFilter();
+            p_particle_color_ = new particleFilter();
+        }
+        p_lane_filter_ = new laneModelFilter();
     }
     catch (std::bad_alloc&)
     {
@@ -59,10 +97,23 @@ navproCore::navproCore(laneTracker* tracker, inputManager* input):
         throw;
     }
 
+    if (filter_mode_ == FUSED_FILTER)
+    {
+        p_particle_fused_->enableAdaptive(MIN_PARTICLES, MAX_PARTICLES);
+    }
+    else
+    {
+        p_particle_edge_->enableAdaptive(MIN_PARTICLES, MAX_PARTICLES);
+        p_particle_marker_->enableAdaptive(MIN_PARTICLES, MAX_PARTICLES);
+        p_particle_color_->enableAdaptive(MIN_PARTICLES, MAX_PARTICLES);
+    }
+
     //set color table used for 8-bits image, should do this only once
     for (int i = 0; i < 256; i++) colorTable.push_back(qRgb(i, i, i));
  
-    probe();
+    //first frame that decodes
+    if (!probe())
+      move();
 }
 
 navproCore::~navproCore()
@@ -74,6 +125,8 @@ navproCore::~navproCore()
     delete p_particle_edge_;
     delete p_particle_marker_;
     delete p_particle_color_;
+    delete p_particle_fused_;
+    delete p_lane_filter_;
 }
 
 void navproCore::paintEvent(QPaintEvent *event)
@@ -185,7 +238,7 @@ void navproCore::paintEvent(QPaintEvent *event)
 //    painter.drawRect(posX - diffX , posY - diffY , rangeX, rangeY);
 }
 
-void navproCore::probe()
+bool navproCore::probe()
 {
     //check pointers available
     assert(p_image_origin_);
@@ -193,97 +246,135 @@ void navproCore::probe()
     assert(p_image_marker_);
     assert(p_image_color_);
 
-    //current image must return true
-    assert(p_input_manager_->getCurrentImage(*p_image_origin_));
+    //display and tracker share one decode. A frame that didn't decode is
+    //left to the caller, frame_ still holds the last good one.
+    if (!p_input_manager_->getCurrentFrame(frame_))
+    {
+        QString path;
+        p_input_manager_->getCurrentImagePath(path);
+        std::cerr<<"skipping frame: "<<path.toAscii().data()<<std::endl;
+        return false;
+    }
+    logPrefetch(p_input_manager_);
+    //Mat frames, e.g. mapped ones, get a QImage only for the window
+    if (display_)
+      *p_image_origin_ = frame_.image();
 
     //process input image
-    QString path;
- 
-    //get current image path
-    p_input_manager_->getCurrentImagePath(path);
- 
-    int error = pTracker->preprocess(path.toAscii().data());
+    int error = pTracker->preprocess(frame_);
     assert(!error);
+    //non-zero means laneTracker workspace is reallocating per frame
+    VERBOSE_LOG("tracker reallocations:"<<pTracker->getReallocations());
+
+    //cues only where particles are, whole frame once track is lost
+    cv::Rect roi;
+    const bool lost = !trackRegion(roi);
+    if (lost)
+      roi = cv::Rect();
+    pTracker->setGlobalSearch(lost);
+    pTracker->setRoi(roi);
+    updateRoadMask();
+    pTracker->setRoadMask(road_mask_);
+    particleFilter* filters[] = {p_particle_edge_, p_particle_marker_,
+                                 p_particle_color_, p_particle_fused_};
+    for(size_t i = 0; i < sizeof(filters)/sizeof(filters[0]); ++i)
+    {
+        if (filters[i])
+          filters[i]->setRegion(roi);
+    }
 
-    //detect edge
-    cv_edge_ = pTracker->edgeDetect();
- 
-    *p_image_edge_ = OPENCV_TO_QT_RGB888(cv_edge_);
+    //filters need edge mask, marker response and road colour model, the
+    //coloured edge image is only looked at
+    int requests = laneTracker::EDGE_MASK | laneTracker::MARKER_RESPONSE |
+                   laneTracker::ROAD_COLOR_MODEL;
+    if (display_)
+      requests |= laneTracker::EDGE_IMAGE;
+    pTracker->detect(requests);
+    VERBOSE_LOG("roi:"<<roi<<" global search:"<<lost
+                <<" coarse frames:"<<pTracker->getCoarseFrames());
 
-    assert(p_particle_edge_);
-    std::cout<<"edge------------------------------>"<<std::endl;
-    p_particle_edge_->measurementUpdate(*p_image_edge_);
-    p_particle_edge_->resample();
+    //detect edge
+    //filters read Canny mask and marker response in place
+    const cv::Mat& edgeMask = pTracker->getEdgeMask();
+    if (display_)
+    {
+        cv_edge_ = pTracker->getEdgeImage();
+        *p_image_edge_ = OPENCV_TO_QT_RGB888(cv_edge_);
+    }
  
     //detect lane marker
-    cv_maker_ = pTracker->laneMarkerDetect();
-    *p_image_marker_ = OPENCV_TO_QT_INDEX8(cv_maker_);
-    //set color table used for 8-bits image
-    p_image_marker_->setColorTable(colorTable);
-
-    assert(p_particle_marker_);
-    std::cout<<"marker------------------------------>"<<std::endl;
-    p_particle_marker_->measurementUpdate(*p_image_marker_);
-    p_particle_marker_->resample();
+    cv_maker_ = pTracker->getMarkerResponse();
+    if (display_)
+    {
+        *p_image_marker_ = OPENCV_TO_QT_INDEX8(cv_maker_);
+        //set color table used for 8-bits image
+        p_image_marker_->setColorTable(colorTable);
+    }
 
     //detect color
-    //array stores R,G,B probabilities
-    p_histogram_ = pTracker->roadColorDetect();
-    //for(int i = 0 ;i <256;i++)
-    //{
-    //    //std::cout<<"r:"<<(*p_histogram_)[2].at<float>(i);
-    //    //std::cout<<" g:"<<(*p_histogram_)[1].at<float>(i);
-    //    //std::cout<<" b:"<<(*p_histogram_)[0].at<float>(i);
-    //    std::cout<<"cr:"<<(*p_histogram_)[0].at<float>(i);
-    //    std::cout<<" cb:"<<(*p_histogram_)[1].at<float>(i);
-    //    std::cout<<std::endl;
-    //}
-
-    QRgb p;
-    int gray;
-    float r, g,b,cr,cb;
-    int width = p_image_origin_->width();
-    int height = p_image_origin_->height();
+    //joint CrCb histogram of road region and its RGB lookup table
+    p_color_model_ = &pTracker->getColorModel();
 
-    float array[width][height];
-    float max = 0.0;
-    for(int x = 0; x < width; x++)
+    particleFilter* colorFilter;
+    const cv::Mat* edgeDistance;
+    const cv::Mat* markerDistance;
+    if (filter_mode_ == FUSED_FILTER)
     {
-        for(int y = 0; y < height; y++)
-        {
-            p = p_image_origin_->pixel(x, y);
-            //b = (*p_histogram_)[0].at<float>(qBlue(p))/100.0;
-            //g = (*p_histogram_)[1].at<float>(qGreen(p))/100.0;
-            //r = (*p_histogram_)[2].at<float>(qRed(p))/100.0;
-            cb = (*p_histogram_)[1].at<float>(RGB2CB(p))/100.0;
-            cr = (*p_histogram_)[0].at<float>(RGB2CR(p))/100.0;
-            //array[x][y] = r*g*b;
-            array[x][y] = cr*cb;
-            if (array[x][y] > max) max = array[x][y];
-        }
+        //one particle set weighted by all cues together
+        assert(p_particle_fused_);
+        VERBOSE_LOG("fused------------------------------>");
+        p_particle_fused_->measurementUpdate(edgeMask, cv_maker_,
+                                             *p_color_model_, frame_.mat());
+        logHealth(p_particle_fused_);
+        p_particle_fused_->resample();
+        colorFilter = p_particle_fused_;
+        edgeDistance = &p_particle_fused_->getDistanceMap(particleFilter::EDGE);
+        markerDistance = &p_particle_fused_->getDistanceMap(particleFilter::LANE_MARKER);
+    }
+    else
+    {
+        assert(p_particle_edge_);
+        VERBOSE_LOG("edge------------------------------>");
+        p_particle_edge_->measurementUpdate(edgeMask);
+        logHealth(p_particle_edge_);
+        p_particle_edge_->resample();
+
+        assert(p_particle_marker_);
+        VERBOSE_LOG("marker------------------------------>");
+        p_particle_marker_->measurementUpdate(cv_maker_);
+        logHealth(p_particle_marker_);
+        p_particle_marker_->resample();
+
+        assert(p_particle_color_);
+        VERBOSE_LOG("color------------------------------>");
+        p_particle_color_->measurementUpdate(*p_color_model_, frame_.mat());
+        logHealth(p_particle_color_);
+        p_particle_color_->resample();
+        colorFilter = p_particle_color_;
+        //single cue updates keep their map in EDGE slot
+        edgeDistance = &p_particle_edge_->getDistanceMap(particleFilter::EDGE);
+        markerDistance = &p_particle_marker_->getDistanceMap(particleFilter::EDGE);
     }
-    std::cout<<"max:"<<max<<std::endl;
 
-    *p_image_color_ = QImage (width, height, QImage::Format_RGB888);
-    p_image_color_->fill(0);
+    //lane model reuses the maps cue filters built this frame
+    assert(p_lane_filter_);
+    VERBOSE_LOG("lane------------------------------>");
+    p_lane_filter_->measurementUpdate(*edgeDistance, *markerDistance,
+                                      colorFilter->getColorProbability());
+    p_lane_filter_->resample();
 
-    for(int x = 0; x < width; x++)
+    //road probability map for display, most road-like pixel is white
+    if (display_)
     {
-        for(int y = 0; y < height; y++)
-        {
-          array[x][y] = array[x][y]/max;
-          gray = array[x][y] * 255;
-          assert(gray >=0 && gray < 256);
-          p_image_color_->setPixel(x, y, qRgb(gray, gray, gray));
-        }
+        const cv::Mat& roadProbability = colorFilter->getColorProbability();
+        double max = 0.0;
+        cv::minMaxLoc(roadProbability, NULL, &max);
+        VERBOSE_LOG("max:"<<max);
+        roadProbability.convertTo(cv_color_, CV_8U, max > 0.0 ? 255.0 / max : 0.0);
+        *p_image_color_ = OPENCV_TO_QT_INDEX8(cv_color_);
+        p_image_color_->setColorTable(colorTable);
     }
 
-    assert(p_particle_color_);
-    bool grayImage = true;
-    std::cout<<"color------------------------------>"<<std::endl;
-    p_particle_color_->measurementUpdate(*p_image_color_, grayImage);
-    p_particle_color_->resample();
-
 #if 0
     //if(pTracker->preprocess(path.toAscii().data()) == -1)
     if(pTracker->preprocess("road/1.JPG") == -1)
@@ -311,18 +402,96 @@ void navproCore::probe()
     //pFilter->measurementUpdate(landMarker); 
     //pFilter->resample();
 #endif
+    return true;
+}
+
+//next frame that decodes, frames that don't are stepped over
+bool navproCore::move()
+{
+    float speed, yawRate;
+    float interval;
+    particleFilter* filters[] = {p_particle_edge_, p_particle_marker_,
+                                 p_particle_color_, p_particle_fused_};
+    do
+    {
+        //motion leading from current image to next one, zero when not logged
+        p_input_manager_->getEgoMotion(speed, yawRate);
+        interval = p_input_manager_->getFrameInterval();
+        if (!p_input_manager_->next())
+        {
+            std::cout<<"last image"<<std::endl;
+            return false;
+        }
+
+        //predict every filter to the new frame before measuring it, also
+        //across a skipped one so its motion isn't lost
+        for(size_t i = 0; i < sizeof(filters)/sizeof(filters[0]); ++i)
+        {
+            if (filters[i])
+              filters[i]->predict(speed, yawRate, interval);
+        }
+        p_lane_filter_->predict(speed, yawRate, interval);
+    } while (!probe());
+    return true;
+}
+
+//fill the estimated lane between its projected boundaries
+void navproCore::updateRoadMask()
+{
+    p_lane_filter_->project(p_lane_filter_->getEstimate(), lane_left_, lane_right_);
+
+    //no-op after first frame
+    road_mask_.create(FRAME_HEIGHT, FRAME_WIDTH, CV_8UC1);
+    road_mask_.setTo(cv::Scalar::all(0));
+
+    //left boundary near to far, then right boundary back far to near
+    lane_outline_.assign(lane_left_.begin(), lane_left_.end());
+    lane_outline_.insert(lane_outline_.end(), lane_right_.rbegin(), lane_right_.rend());
+    const cv::Point* points = &lane_outline_[0];
+    int count = static_cast<int>(lane_outline_.size());
+    cv::fillPoly(road_mask_, &points, &count, 1, cv::Scalar::all(255));
+}
+
+//totals of the per-frame counters --verbose prints
+void navproCore::logSummary() const
+{
+    std::cout<<"tracker reallocations:"<<pTracker->getReallocations()
+             <<" coarse frames:"<<pTracker->getCoarseFrames()<<std::endl;
+    //prefetch counters are totals already
+    const prefetchStats stats = p_input_manager_->getPrefetchStats();
+    std::cout<<"decode workers:"<<stats.workers
+             <<" decode ms mean:"<<stats.meanDecode
+             <<" max:"<<stats.maxDecode
+             <<" stalls:"<<stats.stalls
+             <<" wait ms mean:"<<stats.meanWait<<std::endl;
 }
 
-void navproCore::move()
+//union of every filter's tracked particles, false when any filter reports
+//lost track, so that filter gets whole frame evidence to recover
+bool navproCore::trackRegion(cv::Rect& roi) const
 {
-    //assume velocity is 1m/s, on image, every step move 40 pixles on Y
-    //pFilter->move(40);
-    //if (p_input_manager_->next())
-      probe();
+    const particleFilter* filters[] = {p_particle_edge_, p_particle_marker_,
+                                       p_particle_color_, p_particle_fused_};
+    cv::Rect rect;
+    bool found = false;
+    for(size_t i = 0; i < sizeof(filters)/sizeof(filters[0]); ++i)
+    {
+        if (!filters[i])
+          continue;
+        if (filters[i]->isLost() || !filters[i]->getTrackRect(ROI_MARGIN, rect))
+          return false;
+        roi = found ? (roi | rect) : rect;
+        found = true;
+    }
+    return found;
 }
 
-const M_Prob* navproCore::getParticles(int type)
+const particleFilter* navproCore::getFilter(int type)
 {
+  //fused filter stands for every cue
+  if (filter_mode_ == FUSED_FILTER)
+    return p_particle_fused_;
+
   particleFilter *p;
   switch (type)
   {
@@ -339,7 +508,7 @@ const M_Prob* navproCore::getParticles(int type)
         p = NULL;
       break;
   }
-  return p ? p->getParticles() : NULL;
+  return p;
 }
 
 #if 0
@@ -33,6 +33,7 @@
 #include "environment.h"
 #include "laneTracker.h"
 #include "particleFilter.h"
+#include "laneModelFilter.h"
 #include "inputManager.h"
 
 //#define DEBUG_LOG
@@ -45,33 +46,55 @@ class navproCore : public QWidget
   // center x,y of sample square
   static const float DEFAULT_X_PROPOTION = 0.5;
   static const float DEFAULT_Y_PROPOTION = 0.75;
+
+  // particle count bounds of each cue filter, KLD-sampling picks within
+  static const int MIN_PARTICLES = 200;
+  static const int MAX_PARTICLES = particleFilter::NUMBER_OF_PARTICLES;
+  //pixels added around tracked particles for cue roi
+  static const int ROI_MARGIN = 40;
   
 signals:
   void updateImage(int);
 
 public:
-
-  navproCore(laneTracker* tracker, inputManager* input);
+  // how cues drive particles
+  enum {
+    // one particle set weighted by all cues at once
+    FUSED_FILTER = 0,
+    // one independent filter per cue, for debugging a single cue
+    PER_CUE_FILTERS
+  };
+
+  //display false skips every display-only stage, for headless runs
+  navproCore(laneTracker* tracker, inputManager* input, const int filterMode = FUSED_FILTER,
+             const bool display = true);
   ~navproCore();
   void changeThresholdFrom(const int threshold);
   void changeThresholdTo(const int threshold);
   void showSliderValue(QSlider *pSlider, const QString& text);
   //void probe(const QString& path);
-  void probe();
-  void move();
+  //false when current frame failed to decode, nothing is processed
+  bool probe();
+  //false once there is no next image that decodes
+  bool move();
+  //run totals of tracker and prefetch counters, for the end of a run
+  void logSummary() const;
 
   QImage* getOriginImage() const {return p_image_origin_;};
   QImage* getEdgeImage() const {return p_image_edge_;};
   QImage* getMarkerImage() const {return p_image_marker_;};
   QImage* getColorImage() const {return p_image_color_;};
 
-  const M_Prob* getParticles(int type);
+  const particleFilter* getFilter(int type);
+  const laneModelFilter* getLaneFilter() const { return p_lane_filter_; }
 
 protected:
   void paintEvent(QPaintEvent *event);
   void keyPressEvent(QKeyEvent * e);
 
 private:
+  bool trackRegion(cv::Rect& roi) const;
+  void updateRoadMask();
   bool getStdDeviation(int rangeX, int rangeY, int *hue, int *sat, int *cb, int *cr);
 
   int posX;
@@ -83,9 +106,14 @@ private:
   particleFilter* p_particle_edge_;
   particleFilter* p_particle_marker_;
   particleFilter* p_particle_color_;
+  particleFilter* p_particle_fused_;
+  //lane hypotheses scored on the cue filters' maps
+  laneModelFilter* p_lane_filter_;
 
   inputManager* p_input_manager_;
-  std::vector<cv::Mat>* p_histogram_;
+  const roadColorModel* p_color_model_;
+  int filter_mode_;
+  bool display_;
 
   //Images for display
   QImage *p_image_origin_;
@@ -96,9 +124,18 @@ private:
   //color table for lane marker index8 QImage
   QVector<QRgb> colorTable;
 
+  //current frame, tracker and filters read its mat(), p_image_origin_
+  //shares its pixels when display_ is set
+  videoFrame frame_;
   //Images for processing
   cv::Mat cv_edge_;
   cv::Mat cv_maker_;
   cv::Mat cv_color_;
+  //inside of estimated lane, where colour model learns road
+  cv::Mat road_mask_;
+  //projected lane boundaries and their outline, kept to reuse capacity
+  std::vector<cv::Point> lane_left_;
+  std::vector<cv::Point> lane_right_;
+  std::vector<cv::Point> lane_outline_;
 };
 #endif  //NAVPRO_CORE_H_
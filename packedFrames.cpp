@@ -0,0 +1,136 @@
+/*=============================================================================
+**                            MODULE SPECIFICATION
+===============================================================================
+**
+**  Title : Packed frame container
+**
+**  Description : Writer of the packed frame container, see packedFrames.h
+**
+**
+===============================================================================
+**  Author            :     Xin Zhang
+**  Creation Date     :     2013.06.26
+===============================================================================
+**/
+
+#include <cstring>
+#include <iostream>
+#include "packedFrames.h"
+
+packedFrameWriter::packedFrameWriter()
+  : file_(NULL)
+{
+  memset(&header_, 0, sizeof(header_));
+}
+
+packedFrameWriter::~packedFrameWriter()
+{
+  if (file_)
+    close();
+}
+
+bool packedFrameWriter::open(const QString& path, const int width, const int height,
+                             const int channels)
+{
+  Q_ASSERT(!file_);
+  Q_ASSERT(width > 0 && height > 0 && (channels == 1 || channels == 3));
+
+  try {
+    file_ = new QFile(path);
+  }
+  catch (std::bad_alloc&)
+  {
+    std::cerr<<"Bad alloc!"<<std::endl;
+    throw;
+  }
+  if (!file_->open(QIODevice::WriteOnly | QIODevice::Truncate))
+  {
+    std::cerr<<"can't write "<<path.toAscii().data()<<std::endl;
+    delete file_;
+    file_ = NULL;
+    return false;
+  }
+
+  memset(&header_, 0, sizeof(header_));
+  strncpy(header_.magic, PACKED_MAGIC, sizeof(header_.magic));
+  header_.version = PACKED_VERSION;
+  header_.width = width;
+  header_.height = height;
+  header_.channels = channels;
+  header_.frameBytes = width * height * channels;
+  entries_.clear();
+
+  //placeholder, close() writes the real one
+  return file_->write(reinterpret_cast<const char*>(&header_), sizeof(header_)) ==
+         static_cast<qint64>(sizeof(header_));
+}
+
+//zeros up to next PACKED_ALIGNMENT boundary
+bool packedFrameWriter::pad()
+{
+  static const char zeros[PACKED_ALIGNMENT] = {0};
+  const qint64 gap = (PACKED_ALIGNMENT - file_->pos() % PACKED_ALIGNMENT) % PACKED_ALIGNMENT;
+  return gap == 0 || file_->write(zeros, gap) == gap;
+}
+
+//name and its terminating zero fit an entry
+bool packedFrameWriter::nameFits(const QString& name)
+{
+  return name.toAscii().size() < PACKED_NAME_SIZE;
+}
+
+bool packedFrameWriter::append(const cv::Mat& frame, const QString& name, const double timestamp)
+{
+  Q_ASSERT(file_);
+  Q_ASSERT(frame.cols == static_cast<int>(header_.width) &&
+           frame.rows == static_cast<int>(header_.height) &&
+           frame.type() == CV_8UC(header_.channels));
+  const QByteArray ascii = name.toAscii();
+  if (!nameFits(name))
+  {
+    std::cerr<<"frame name over "<<PACKED_NAME_SIZE - 1<<" bytes: "<<ascii.data()<<std::endl;
+    return false;
+  }
+  if (!pad())
+    return false;
+
+  packedEntry entry;
+  memset(&entry, 0, sizeof(entry));
+  entry.offset = file_->pos();
+  entry.timestamp = timestamp;
+  entry.nameLength = ascii.size();
+  memcpy(entry.name, ascii.data(), entry.nameLength);
+
+  //row by row, frame may be a view with padded rows
+  const qint64 rowBytes = header_.width * header_.channels;
+  for (int y = 0; y < frame.rows; ++y)
+  {
+    if (file_->write(reinterpret_cast<const char*>(frame.ptr(y)), rowBytes) != rowBytes)
+      return false;
+  }
+  entries_.push_back(entry);
+  return true;
+}
+
+bool packedFrameWriter::close()
+{
+  if (!file_)
+    return false;
+
+  bool ok = pad();
+  header_.tableOffset = file_->pos();
+  header_.frameCount = entries_.size();
+  if (ok && !entries_.empty())
+  {
+    const qint64 tableBytes = entries_.size() * sizeof(packedEntry);
+    ok = file_->write(reinterpret_cast<const char*>(&entries_[0]), tableBytes) == tableBytes;
+  }
+  ok = ok && file_->seek(0) &&
+       file_->write(reinterpret_cast<const char*>(&header_), sizeof(header_)) ==
+       static_cast<qint64>(sizeof(header_));
+
+  file_->close();
+  delete file_;
+  file_ = NULL;
+  return ok;
+}
@@ -0,0 +1,92 @@
+/*=============================================================================
+**                            MODULE SPECIFICATION
+===============================================================================
+**
+**  Title : Packed frame container
+**
+**  Description : File of fixed size, already preprocessed frames for fast
+**                replay. Layout, host byte order:
+**
+**                  packedHeader
+**                  frame data, each frame PACKED_ALIGNMENT aligned, rows
+**                  packed, width * height * channels bytes (BGR or gray)
+**                  packedEntry table of frameCount entries at tableOffset
+**
+**                Readers map the file and view frames in place, see
+**                packedFileSource. packedFrameWriter builds one.
+**
+**
+===============================================================================
+**  Author            :     Xin Zhang
+**  Creation Date     :     2013.06.26
+===============================================================================
+**/
+
+#ifndef NAVPRO_PACKED_FRAMES_H_
+#define NAVPRO_PACKED_FRAMES_H_
+
+#include <vector>
+#include <QFile>
+#include <QString>
+#include <QtGlobal>
+#include <opencv2/core/core.hpp>
+
+#define PACKED_MAGIC     "NAVPACK"
+#define PACKED_VERSION   2
+#define PACKED_ALIGNMENT 64
+#define PACKED_NAME_SIZE 48
+
+struct packedHeader
+{
+  //PACKED_MAGIC, zero padded
+  char magic[8];
+  quint32 version;
+  quint32 width;
+  quint32 height;
+  //3 for BGR, 1 for gray
+  quint32 channels;
+  quint32 frameCount;
+  quint32 frameBytes;
+  quint64 tableOffset;
+};
+
+struct packedEntry
+{
+  //of frame data from start of file
+  quint64 offset;
+  //seconds since first frame
+  double timestamp;
+  //bytes of name before its terminating zero
+  quint32 nameLength;
+  //key in ego-motion log, zero terminated, never truncated
+  char name[PACKED_NAME_SIZE];
+};
+
+class packedFrameWriter
+{
+  public:
+    packedFrameWriter();
+    ~packedFrameWriter();
+
+    // start a container of width x height frames with channels 1 or 3
+    bool open(const QString& path, const int width, const int height, const int channels);
+    // frame must match the size and channels given to open(). A name that
+    // doesn't fit is rejected, it would no longer match the ego-motion log.
+    bool append(const cv::Mat& frame, const QString& name, const double timestamp);
+    static bool nameFits(const QString& name);
+    // write offset table and header, the file is unreadable until then
+    bool close();
+    int getFrameCount() const { return entries_.size(); }
+
+  private:
+    packedFrameWriter            (const packedFrameWriter &);
+    packedFrameWriter& operator= (const packedFrameWriter &);
+
+    bool pad();
+
+    QFile* file_;
+    packedHeader header_;
+    std::vector<packedEntry> entries_;
+};
+
+#endif //NAVPRO_PACKED_FRAMES_H_
@@ -16,180 +16,1098 @@
 ===============================================================================
 **/
 
+#include <algorithm>
 #include <iostream>
+#include <cfloat>
+#include <climits>
+#include <cstring>
 #include <QColor>
+#include <QThread>
+#include <QThreadPool>
+#include <opencv2/imgproc/imgproc.hpp>
+#include "coordinateSystems.h"
 #include "particleFilter.h"
 
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+
 using namespace cv;
 
-particleFilter::particleFilter()
-    : globleNoise(100.0),
-    pMeasureArray(NULL)
+const float particleFilter::COLOR_FLOOR = 0.01;
+//log weight of a particle that has none
+static const float LOG_ZERO = -FLT_MAX;
+
+//SIMD kernels over particle arrays, every kernel has a scalar tail so the
+//particle count doesn't need to be a multiple of the vector width
+
+//return max of v[0, n)
+static float maxOf(const float* v, const int n)
+{
+    int i = 0;
+    float m = 0.0;
+#ifdef __SSE2__
+    __m128 m4 = _mm_setzero_ps();
+    for(; i + 4 <= n; i += 4)
+      m4 = _mm_max_ps(m4, _mm_load_ps(v + i));
+    float lane[4];
+    _mm_storeu_ps(lane, m4);
+    m = qMax(qMax(lane[0], lane[1]), qMax(lane[2], lane[3]));
+#endif
+    for(; i < n; ++i)
+      m = qMax(m, v[i]);
+    return m;
+}
+
+//v[i] += d for i in [0, n)
+static void addTo(float* v, const int n, const float d)
 {
+    int i = 0;
+#ifdef __SSE2__
+    const __m128 d4 = _mm_set1_ps(d);
+    for(; i + 4 <= n; i += 4)
+      _mm_store_ps(v + i, _mm_add_ps(_mm_load_ps(v + i), d4));
+#endif
+    for(; i < n; ++i)
+      v[i] += d;
+}
+
+//return sum of v[0, n)
+static float sumOf(const float* v, const int n)
+{
+    int i = 0;
+    float sum = 0.0;
+#ifdef __SSE2__
+    __m128 s4 = _mm_setzero_ps();
+    for(; i + 4 <= n; i += 4)
+      s4 = _mm_add_ps(s4, _mm_load_ps(v + i));
+    float lane[4];
+    _mm_storeu_ps(lane, s4);
+    sum = (lane[0] + lane[1]) + (lane[2] + lane[3]);
+#endif
+    for(; i < n; ++i)
+      sum += v[i];
+    return sum;
+}
+
+//w[i] *= l[i] for i in [0, n)
+static void multiplyBy(float* w, const float* l, const int n)
+{
+    int i = 0;
+#ifdef __SSE2__
+    for(; i + 4 <= n; i += 4)
+      _mm_store_ps(w + i, _mm_mul_ps(_mm_load_ps(w + i), _mm_load_ps(l + i)));
+#endif
+    for(; i < n; ++i)
+      w[i] *= l[i];
+}
+
+//v[i] *= s for i in [0, n)
+static void scaleBy(float* v, const int n, const float s)
+{
+    int i = 0;
+#ifdef __SSE2__
+    const __m128 s4 = _mm_set1_ps(s);
+    for(; i + 4 <= n; i += 4)
+      _mm_store_ps(v + i, _mm_mul_ps(_mm_load_ps(v + i), s4));
+#endif
+    for(; i < n; ++i)
+      v[i] *= s;
+}
+
+//v[i] = c for i in [0, n)
+static void fill(float* v, const int n, const float c)
+{
+    int i = 0;
+#ifdef __SSE2__
+    const __m128 c4 = _mm_set1_ps(c);
+    for(; i + 4 <= n; i += 4)
+      _mm_store_ps(v + i, c4);
+#endif
+    for(; i < n; ++i)
+      v[i] = c;
+}
+
+//one aligned block holds x, y and weight, each array padded to SIMD width
+static bool allocateParticles(particleSet& set, const int n)
+{
+    int stride = (n + 3) & ~3;
     try {
-        pMeasureArray = new M_Prob[NUMBER_OF_PARTICLES];
+        set.x = static_cast<float*>(fastMalloc(3 * stride * sizeof(float)));
+    }
+    catch (cv::Exception& e)
+    {
+        std::cerr<<"particle alloc failed:"<<e.what()<<std::endl;
+        set.x = NULL;
+        return false;
+    }
+    set.y = set.x + stride;
+    set.weight = set.y + stride;
+    return true;
+}
+
+static void freeParticles(particleSet& set)
+{
+    fastFree(set.x);
+    set.x = set.y = set.weight = NULL;
+}
+
+//distances in a (width + 1) x (height + 1) map are below its diagonal + 1
+static int tableSize(const int width, const int height)
+{
+    return static_cast<int>(sqrt((width + 1.0) * (width + 1.0) + (height + 1.0) * (height + 1.0))) + 1;
+}
+
+//worker of one particle block, reused frame after frame
+class particleFilter::blockTask : public QRunnable
+{
+  public:
+    blockTask(particleFilter* filter, QSemaphore* done)
+      : p_filter_(filter),
+        p_done_(done),
+        job_(0),
+        begin_(0),
+        end_(0)
+    {
+        //owned by particleFilter, pool must not delete it
+        setAutoDelete(false);
     }
-    catch (std::bad_alloc& ba)
+
+    void setJob(const int job, const int begin, const int end)
     {
-        std::cerr<<"bad_alloc caught:"<<ba.what()<<std::endl;
+        job_ = job;
+        begin_ = begin;
+        end_ = end;
+    }
+
+    void run()
+    {
+        p_filter_->runBlock(job_, begin_, end_);
+        p_done_->release();
+    }
+
+  private:
+    particleFilter* p_filter_;
+    QSemaphore* p_done_;
+    int job_;
+    int begin_;
+    int end_;
+};
+
+particleFilter::particleFilter(const int count)
+    : globleNoise(100.0),
+    particleCount(count),
+    capacity(0),
+    measureMode(DISTANCE_TRANSFORM),
+    resampleMethod(RESAMPLE_SYSTEMATIC),
+    likelihood(NULL),
+    cumulative(NULL),
+    adaptive(false),
+    minParticles(count),
+    maxParticles(count),
+    kldEpsilon(0.05),
+    kldZ(2.326),
+    kldBinSize(20),
+    binStamp(0),
+    threadCount(QThread::idealThreadCount()),
+    frameWidth(0),
+    frameHeight(0),
+    seedValue(DEFAULT_SEED),
+    random(DEFAULT_SEED),
+    diffuseSigmaX(0.0),
+    diffuseSigmaY(0.0),
+    fuseMaxLog(0.0),
+    predictDistance(0.0),
+    predictCos(1.0),
+    predictSin(0.0),
+    processNoiseX(2.0),
+    processNoiseY(2.0),
+    resampleThreshold(0.5),
+    lostThreshold(0.95)
+{
+    Q_ASSERT(particleCount > 0);
+    gaussian.build(globleNoise, tableSize(FRAME_WIDTH, FRAME_HEIGHT));
+    if (reserve(particleCount))
+      scatter();
+
+    for(int c = 0; c < NUMBER_OF_CUES; ++c)
+    {
+        cueActive[c] = false;
+        cueWeights[c] = 1.0;
     }
 
     //printParticles();
 }
 
+//spread particles uniformly over the frame, every weight 1/N
+void particleFilter::scatter()
+{
+    for(int i = 0; i < particleCount; ++i)
+    {
+        particles.x[i] = random.uniformInt(0, FRAME_WIDTH);
+        particles.y[i] = random.uniformInt(0, FRAME_HEIGHT);
+    }
+    fill(particles.weight, particleCount, 1.0 / particleCount);
+}
+
+//restart every generator from value and scatter particles again, so two
+//filters seeded alike run identically, serial or parallel
+void particleFilter::seed(const quint64 value)
+{
+    seedValue = value;
+    random.seed(seedValue);
+    for(size_t c = 0; c < chunkRandom.size(); ++c)
+      chunkRandom[c].seed(seedValue, c + 1);
+
+    if (particles.x)
+      scatter();
+}
+
 particleFilter::~particleFilter()
 {
-    delete[] pMeasureArray;
-    pMeasureArray = NULL;
+    for(size_t i = 0; i < tasks.size(); ++i)
+      delete tasks[i];
+
+    freeParticles(particles);
+    freeParticles(spare);
+    fastFree(likelihood);
+    likelihood = NULL;
+    cumulative = NULL;
 }
 
-void particleFilter::measurementUpdate(const std::vector<Mat>& rgbHistogram, const QImage& rawImage)
+//grow every per particle buffer to hold n particles, keeping current ones.
+//Only called at construction and configuration, never from a frame update.
+bool particleFilter::reserve(const int n)
 {
-    Mat bHist = rgbHistogram[0];
-    Mat gHist = rgbHistogram[1];
-    Mat rHist = rgbHistogram[2];
-    QRgb p;
-    float probRoad[rawImage.width()][rawImage.height()];
-    std::cout<<"B hist Y:"<<bHist.rows<<" X:"<<bHist.cols<<std::endl;
+    if (n <= capacity)
+      return true;
+
+    particleSet grown, grownSpare;
+    float* scratch = NULL;
+    if (!allocateParticles(grown, n) || !allocateParticles(grownSpare, n))
+    {
+        freeParticles(grown);
+        return false;
+    }
+
+    try {
+        //likelihood and cumulative weights share one block
+        scratch = static_cast<float*>(fastMalloc(2 * n * sizeof(float)));
+    }
+    catch (cv::Exception& e)
+    {
+        std::cerr<<"scratch alloc failed:"<<e.what()<<std::endl;
+        freeParticles(grown);
+        freeParticles(grownSpare);
+        return false;
+    }
 
-    for(int x = 0; x < rawImage.width(); ++x)
+    if (particles.x)
     {
-        for(int y = 0; y < rawImage.height(); ++y)
+        memcpy(grown.x, particles.x, particleCount * sizeof(float));
+        memcpy(grown.y, particles.y, particleCount * sizeof(float));
+        memcpy(grown.weight, particles.weight, particleCount * sizeof(float));
+    }
+
+    freeParticles(particles);
+    freeParticles(spare);
+    fastFree(likelihood);
+
+    particles = grown;
+    spare = grownSpare;
+    likelihood = scratch;
+    cumulative = scratch + n;
+    capacity = n;
+
+    //one stream per MIN_BLOCK_SIZE chunk, stream 0 is the filter's own
+    while (static_cast<int>(chunkRandom.size()) * MIN_BLOCK_SIZE < capacity)
+      chunkRandom.push_back(randomGenerator(seedValue, chunkRandom.size() + 1));
+    return true;
+}
+
+void particleFilter::setNoise(const float noise)
+{
+    Q_ASSERT(noise > 0.0);
+    if (noise == globleNoise)
+      return;
+
+    globleNoise = noise;
+    //new sigma, whole table is rebuilt
+    gaussian = likelihoodTable();
+    gaussian.build(globleNoise, tableSize(qMax(frameWidth, static_cast<int>(FRAME_WIDTH)),
+                                          qMax(frameHeight, static_cast<int>(FRAME_HEIGHT))));
+}
+
+void particleFilter::enableAdaptive(const int minCount, const int maxCount)
+{
+    Q_ASSERT(minCount > 0 && minCount <= maxCount);
+    if (!reserve(maxCount))
+      return;
+
+    minParticles = minCount;
+    maxParticles = maxCount;
+    adaptive = true;
+    setKldParameters(kldEpsilon, kldZ, kldBinSize);
+}
+
+void particleFilter::disableAdaptive()
+{
+    adaptive = false;
+}
+
+void particleFilter::setKldParameters(const float epsilon, const float z, const int binSize)
+{
+    Q_ASSERT(epsilon > 0.0 && binSize > 0);
+    kldEpsilon = epsilon;
+    kldZ = z;
+    kldBinSize = binSize;
+
+    //bins cover the frame, particles off the frame fall into border bins
+    binCols = FRAME_WIDTH / kldBinSize + 1;
+    binRows = FRAME_HEIGHT / kldBinSize + 1;
+    binStamps.assign(binCols * binRows, 0);
+    binStamp = 0;
+}
+
+void particleFilter::measurementUpdate(const roadColorModel& model, const QImage& rawImage)
+{
+    QImage rgb;
+    measurementUpdate(model, toBgra(rawImage, rgb));
+}
+
+void particleFilter::measurementUpdate(const roadColorModel& model, const Mat& rawImage)
+{
+    frameWidth = rawImage.cols;
+    frameHeight = rawImage.rows;
+
+    if (buildColorProbability(model, rawImage))
+    {
+        runBlocks(COLOR_JOB);
+        normalize();
+    }
+
+    printParticles("Color update");
+}
+
+//back-project the road colour model onto rawImage: every pixel's road
+//probability is one load from the model's quantized RGB table
+bool particleFilter::buildColorProbability(const roadColorModel& model, const Mat& rawImage)
+{
+    if (rawImage.empty())
+      return false;
+    Q_ASSERT(rawImage.type() == CV_8UC4 || rawImage.type() == CV_8UC3 ||
+             rawImage.type() == CV_8UC1);
+
+    const float* table = model.getRgbTable();
+
+    //no-op while frame size doesn't change
+    colorProbability.create(rawImage.rows, rawImage.cols, CV_32FC1);
+
+    //pixels outside region are not road
+    const cv::Rect area = activeRegion(rawImage.cols, rawImage.rows);
+    if (area.area() < rawImage.cols * rawImage.rows)
+      colorProbability = Scalar::all(0);
+
+    //bytes are B, G, R(, A), gray repeats its one byte
+    const int step = rawImage.channels();
+    const int green = step > 1 ? 1 : 0;
+    const int red = step > 1 ? 2 : 0;
+    const uchar* in;
+    float* out;
+    for(int y = area.y; y < area.y + area.height; ++y)
+    {
+        in = rawImage.ptr(y) + area.x * step;
+        out = colorProbability.ptr<float>(y);
+        for(int x = area.x; x < area.x + area.width; ++x, in += step)
+          out[x] = table[roadColorModel::rgbIndex(in[red], in[green], in[0])];
+    }
+    return true;
+}
+
+void particleFilter::measurementUpdate(const QImage& image, bool grayImage)
+{
+    (void)grayImage;
+    toMask(image, imageMasks[0]);
+    measurementUpdate(imageMasks[0]);
+}
+
+void particleFilter::measurementUpdate(const Mat& featureMask)
+{
+    Q_ASSERT(featureMask.type() == CV_8UC1);
+    frameWidth = featureMask.cols;
+    frameHeight = featureMask.rows;
+    //no-op unless frame grew past the table
+    gaussian.build(globleNoise, tableSize(frameWidth, frameHeight));
+
+    //frame wide preparation is serial, per particle work runs in blocks
+    bool found;
+    if (measureMode == DISTANCE_TRANSFORM)
+      found = buildDistanceMap(featureMask, distanceMaps[0]);
+    else
+      found = collectFeatures(featureMask);
+
+    //no feature pixel, no particle is touched
+    if (found)
+    {
+        runBlocks(MEASURE_JOB);
+        normalize();
+    }
+
+    printParticles("Measure update");
+}
+
+void particleFilter::measurementUpdate(const QImage& edgeImage, const QImage& markerImage,
+                                       const roadColorModel& model, const QImage& rawImage)
+{
+    toMask(edgeImage, imageMasks[EDGE]);
+    toMask(markerImage, imageMasks[LANE_MARKER]);
+    QImage rgb;
+    measurementUpdate(imageMasks[EDGE], imageMasks[LANE_MARKER], model, toBgra(rawImage, rgb));
+}
+
+void particleFilter::measurementUpdate(const Mat& edgeMask, const Mat& markerMask,
+                                       const roadColorModel& model, const Mat& rawImage)
+{
+    Q_ASSERT(edgeMask.type() == CV_8UC1 && markerMask.type() == CV_8UC1);
+    frameWidth = qMax(edgeMask.cols, markerMask.cols);
+    frameHeight = qMax(edgeMask.rows, markerMask.rows);
+    gaussian.build(globleNoise, tableSize(frameWidth, frameHeight));
+
+    //a cue without features carries no evidence
+    cueActive[EDGE] = buildDistanceMap(edgeMask, distanceMaps[EDGE]);
+    cueActive[LANE_MARKER] = buildDistanceMap(markerMask, distanceMaps[LANE_MARKER]);
+    cueActive[COLOR] = buildColorProbability(model, rawImage);
+
+    if (cueActive[EDGE] || cueActive[LANE_MARKER] || cueActive[COLOR])
+    {
+        //log weights into likelihood, then weights relative to the largest
+        runBlocks(FUSE_JOB);
+        fuseMaxLog = LOG_ZERO;
+        for(int k = 0; k < particleCount; ++k)
+          fuseMaxLog = qMax(fuseMaxLog, likelihood[k]);
+        runBlocks(EXP_JOB);
+        normalize();
+    }
+
+    printParticles("Fused update");
+}
+
+void particleFilter::setCueWeight(const int cue, const float weight)
+{
+    Q_ASSERT(cue >= 0 && cue < NUMBER_OF_CUES && weight >= 0.0);
+    cueWeights[cue] = weight;
+}
+
+//region clipped to a width x height frame, whole frame when none is set
+cv::Rect particleFilter::activeRegion(const int width, const int height) const
+{
+    const cv::Rect frame(0, 0, width, height);
+    if (region.area() <= 0)
+      return frame;
+    return region & frame;
+}
+
+//bounding box of particles that carry weight, so freshly scattered ones
+//don't stretch it over the whole frame. Weights never all vanish, scatter()
+//and normalize() fall back to uniform, so loss comes from health instead.
+bool particleFilter::getTrackRect(const int margin, cv::Rect& rect) const
+{
+    if (health.lost)
+      return false;
+
+    float left = FRAME_WIDTH, top = FRAME_HEIGHT, right = 0.0, bottom = 0.0;
+    bool tracked = false;
+    for(int k = 0; k < particleCount; ++k)
+    {
+        if (particles.weight[k] <= 0.0)
+          continue;
+        left = qMin(left, particles.x[k]);
+        right = qMax(right, particles.x[k]);
+        top = qMin(top, particles.y[k]);
+        bottom = qMax(bottom, particles.y[k]);
+        tracked = true;
+    }
+    if (!tracked)
+      return false;
+
+    rect = cv::Rect(cv::Point(static_cast<int>(left) - margin, static_cast<int>(top) - margin),
+                    cv::Point(static_cast<int>(right) + margin + 1, static_cast<int>(bottom) + margin + 1)) &
+           cv::Rect(0, 0, FRAME_WIDTH, FRAME_HEIGHT);
+    return rect.area() > 0;
+}
+
+//255 where image is not black, alpha ignored, for QImage callers
+void particleFilter::toMask(const QImage& image, Mat& mask)
+{
+    mask.create(image.height(), image.width(), CV_8UC1);
+    uchar* row;
+    for(int j = 0; j < image.height(); ++j)
+    {
+        row = mask.ptr(j);
+        for(int i = 0; i < image.width(); ++i)
+          row[i] = (image.pixel(i, j) & RGB_MASK) ? 255 : 0;
+    }
+}
+
+//BGRA view of image, converted into rgb first unless it's RGB32 already,
+//whose little-endian bytes are B, G, R, A. Valid while rgb lives.
+Mat particleFilter::toBgra(const QImage& image, QImage& rgb)
+{
+    if (image.isNull())
+      return Mat();
+    rgb = image;
+    if (rgb.format() != QImage::Format_RGB32 && rgb.format() != QImage::Format_ARGB32)
+      rgb = rgb.convertToFormat(QImage::Format_RGB32);
+    return Mat(rgb.height(), rgb.width(), CV_8UC4,
+               const_cast<uchar*>(rgb.constBits()), rgb.bytesPerLine());
+}
+
+//feature pixels are non-zero pixels of the down-half mask
+bool particleFilter::collectFeatures(const Mat& mask)
+{
+    features.clear();
+    const cv::Rect area = activeRegion(frameWidth, frameHeight);
+    for(int i = area.x; i < area.x + area.width; ++i)
+    {
+        for(int j = qMax(frameHeight/2, area.y); j < area.y + area.height; ++j)
         {
-            p = rawImage.pixel(x, y);
-            // get probability of blue
-            probRoad[x][y] = bHist.at<int>(qBlue (p)) *
-                       gHist.at<int>(qGreen(p)) *
-                       rHist.at<int>(qRed  (p)); 
+            if (mask.at<uchar>(j, i))
+              features.push_back(cv::Point(i, j));
         }
     }
+    return !features.empty();
 }
 
-void particleFilter::measurementUpdate(const QImage& image, bool grayImage)
+//Gaussian() decreases with distance, so the max Gaussian over all feature
+//pixels is the Gaussian of the nearest one. Build the nearest distance of
+//every pixel once, O(pixels), then each particle is one lookup.
+bool particleFilter::buildDistanceMap(const Mat& mask, Mat& distanceMap)
+{
+    //particles are accepted up to (width, height) inclusive, so map has one
+    //more column and row, which never hold a feature
+    featureMap.create(frameHeight + 1, frameWidth + 1, CV_8UC1);
+    featureMap = Scalar::all(255);
+
+    //only the down half inside region is searched
+    cv::Rect area = activeRegion(mask.cols, mask.rows);
+    const int top = qMax(mask.rows/2, area.y);
+    area.height = qMax(0, area.y + area.height - top);
+    area.y = top;
+
+    int found = 0;
+    if (area.area() > 0)
+    {
+        found = countNonZero(mask(area));
+        //distanceTransform() measures to nearest zero pixel, so feature
+        //pixels become 0 and the rest 255
+        Mat window = featureMap(area);
+        compare(mask(area), Scalar::all(0), window, CMP_EQ);
+    }
+
+    //stale map from an earlier frame must not be read as evidence
+    if (found == 0)
+    {
+        distanceMap.release();
+        return false;
+    }
+
+    //precise mask gives exact euclidean distance, truncated like Distance()
+    distanceTransform(featureMap, distanceMap, CV_DIST_L2, CV_DIST_MASK_PRECISE);
+    return true;
+}
+
+void particleFilter::runBlock(const int job, const int begin, const int end)
+{
+    if (job == DIFFUSE_JOB)
+      diffuseBlock(begin, end);
+    else if (job == PREDICT_JOB)
+      predictBlock(begin, end);
+    else if (job == COLOR_JOB)
+      colorBlock(begin, end);
+    else if (job == FUSE_JOB)
+      fuseBlock(begin, end);
+    else if (job == EXP_JOB)
+      expBlock(begin, end);
+    else
+      measureBlock(begin, end);
+}
+
+void particleFilter::measureBlock(const int begin, const int end)
+{
+    if (measureMode == DISTANCE_TRANSFORM)
+      distanceBlock(begin, end);
+    else
+      exhaustiveBlock(begin, end);
+}
+
+void particleFilter::exhaustiveBlock(const int begin, const int end)
 {
-    int height = image.height();
-    int width  = image.width();
     int dist;
-    int i,j,k;
     float prob;
-    for(i = 0; i < width; ++i)
+    //particle off the image explains nothing
+    fill(likelihood + begin, end - begin, 0.0);
+    std::vector<cv::Point>::const_iterator it;
+    for(it = features.begin(); it != features.end(); ++it)
+    {
+        for(int k = begin; k < end; ++k)
+        {
+            //check particle filter is in this image
+            if (!onFrame(k))
+              continue;
+
+            dist = Distance(particles.x[k], particles.y[k], it->x, it->y);
+            prob = gaussian[dist];
+            if (prob > likelihood[k])
+              likelihood[k] = prob;
+        }
+    }
+
+    multiplyBy(particles.weight + begin, likelihood + begin, end - begin);
+}
+
+void particleFilter::distanceBlock(const int begin, const int end)
+{
+    //gather Gaussian of nearest feature, then weight *= likelihood.
+    //Map distances never exceed its diagonal, which the table covers.
+    const float* table = gaussian.data();
+    int dist;
+    for(int k = begin; k < end; ++k)
+    {
+        //check particle filter is in this image
+        if (!onFrame(k))
+        {
+            likelihood[k] = 0.0;
+            continue;
+        }
+
+        dist = static_cast<int>(distanceMaps[0].at<float>(static_cast<int>(particles.y[k]),
+                                                          static_cast<int>(particles.x[k])));
+        likelihood[k] = table[dist];
+    }
+
+    multiplyBy(particles.weight + begin, likelihood + begin, end - begin);
+}
+
+//road probability under each particle, 0 off the map
+void particleFilter::colorBlock(const int begin, const int end)
+{
+    for(int k = begin; k < end; ++k)
+    {
+        if (particles.x[k] < 0 || particles.x[k] >= colorProbability.cols ||
+            particles.y[k] < 0 || particles.y[k] >= colorProbability.rows)
+        {
+            likelihood[k] = 0.0;
+            continue;
+        }
+
+        likelihood[k] = colorProbability.at<float>(static_cast<int>(particles.y[k]),
+                                                   static_cast<int>(particles.x[k]));
+    }
+
+    multiplyBy(particles.weight + begin, likelihood + begin, end - begin);
+}
+
+//log of prior weight times fused likelihood into likelihood[k]. The sum
+//of three far cues is far below what exp() can return in float, only the
+//difference to the best particle is exponentiated, in expBlock().
+void particleFilter::fuseBlock(const int begin, const int end)
+{
+    const float* logTable = gaussian.logData();
+    int x, y, c;
+    float logSum;
+    for(int k = begin; k < end; ++k)
+    {
+        //particle off every cue image explains nothing
+        if (!onFrame(k) || particles.weight[k] <= 0.0)
+        {
+            likelihood[k] = LOG_ZERO;
+            continue;
+        }
+
+        x = static_cast<int>(particles.x[k]);
+        y = static_cast<int>(particles.y[k]);
+        logSum = 0.0;
+        for(c = EDGE; c <= LANE_MARKER; ++c)
+        {
+            if (cueActive[c] && cueWeights[c] > 0.0)
+              logSum += cueWeights[c] * logTable[static_cast<int>(distanceMaps[c].at<float>(y, x))];
+        }
+
+        //floor keeps one off-colour pixel from vetoing the other cues
+        if (cueActive[COLOR] && cueWeights[COLOR] > 0.0)
+        {
+            float road = (x < colorProbability.cols && y < colorProbability.rows) ?
+                         colorProbability.at<float>(y, x) : 0.0;
+            logSum += cueWeights[COLOR] * log(COLOR_FLOOR + road);
+        }
+        likelihood[k] = log(particles.weight[k]) + logSum;
+    }
+}
+
+//weight = exp(log weight - largest log weight), best particle gets 1 and
+//normalize() scales the rest
+void particleFilter::expBlock(const int begin, const int end)
+{
+    for(int k = begin; k < end; ++k)
+      particles.weight[k] = likelihood[k] > LOG_ZERO ? exp(likelihood[k] - fuseMaxLog) : 0.0;
+}
+
+//split particles into blocks of whole MIN_BLOCK_SIZE chunks, run all but
+//the first on the shared thread pool and the first one on the caller's
+//thread. A particle's weight only depends on itself and the frame, and its
+//noise only on its chunk's stream, so results are identical to the serial
+//path whatever the split.
+void particleFilter::runBlocks(const int job)
+{
+    int chunks = (particleCount + MIN_BLOCK_SIZE - 1) / MIN_BLOCK_SIZE;
+    int blocks = qMin(threadCount, chunks);
+    if (blocks <= 1)
+    {
+        runBlock(job, 0, particleCount);
+        return;
+    }
+
+    //chunk starts are 16-byte aligned too, as SIMD kernels need
+    int blockSize = ((chunks + blocks - 1) / blocks) * MIN_BLOCK_SIZE;
+    while (static_cast<int>(tasks.size()) < blocks - 1)
+      tasks.push_back(new blockTask(this, &blocksDone));
+
+    int started = 0;
+    for(int begin = blockSize; begin < particleCount; begin += blockSize)
+    {
+        tasks[started]->setJob(job, begin, qMin(begin + blockSize, particleCount));
+        QThreadPool::globalInstance()->start(tasks[started]);
+        ++started;
+    }
+
+    runBlock(job, 0, qMin(blockSize, particleCount));
+    blocksDone.acquire(started);
+}
+
+//jitter every particle with zero mean Gaussian noise
+void particleFilter::diffuse(const float sigmaX, const float sigmaY)
+{
+    diffuseSigmaX = sigmaX;
+    diffuseSigmaY = sigmaY;
+    runBlocks(DIFFUSE_JOB);
+}
+
+void particleFilter::diffuseBlock(const int begin, const int end)
+{
+    int chunkEnd;
+    for(int chunk = begin; chunk < end; chunk = chunkEnd)
     {
-        for(j = height/2; j < height; ++j)
+        chunkEnd = qMin(chunk + MIN_BLOCK_SIZE, end);
+        randomGenerator& r = chunkRandom[chunk / MIN_BLOCK_SIZE];
+        for(int k = chunk; k < chunkEnd; ++k)
         {
-            if (QColor(image.pixel(i, j)) != QColor(Qt::black))
+            particles.x[k] += diffuseSigmaX * r.normal();
+            particles.y[k] += diffuseSigmaY * r.normal();
+        }
+    }
+}
+
+void particleFilter::setProcessNoise(const float sigmaX, const float sigmaY)
+{
+    Q_ASSERT(sigmaX >= 0.0 && sigmaY >= 0.0);
+    processNoiseX = sigmaX;
+    processNoiseY = sigmaY;
+}
+
+void particleFilter::predict(const float speed, const float yawRate, const float interval)
+{
+    predictDistance = speed * interval;
+    predictCos = cos(yawRate * interval);
+    predictSin = sin(yawRate * interval);
+    runBlocks(PREDICT_JOB);
+
+    //re-seeded particles came back at the mean weight 1/N, sum isn't 1
+    //any more
+    float total = sumOf(particles.weight, particleCount);
+    if (total > 0.0)
+      scaleBy(particles.weight, particleCount, 1.0 / total);
+}
+
+//particles are image points on the road surface. Map each back to the road,
+//move it by the inverse of the vehicle's motion, and project it again.
+//Particles at or above horizon have no road point and only get noise.
+void particleFilter::predictBlock(const int begin, const int end)
+{
+    Point3D road;
+    ::Point image;
+    float x, y;
+    int chunkEnd;
+    for(int chunk = begin; chunk < end; chunk = chunkEnd)
+    {
+        chunkEnd = qMin(chunk + MIN_BLOCK_SIZE, end);
+        randomGenerator& r = chunkRandom[chunk / MIN_BLOCK_SIZE];
+        for(int k = chunk; k < chunkEnd; ++k)
+        {
+            if (IPCS2RCS(::Point(particles.x[k], particles.y[k]), road))
             {
-                for(k = 0; k < NUMBER_OF_PARTICLES; ++k)
-                {
-                    //check particle filter is in this image
-                    if (pMeasureArray[k].x > width || pMeasureArray[k].y > height)
-                      continue;
-
-                    dist = Distance(pMeasureArray[k].x, pMeasureArray[k].y, i, j);
-                    prob = Gaussian(dist, globleNoise, 0);
-                    if (prob > pMeasureArray[k].probability)
-                    {
-                       pMeasureArray[k].probability = prob;
-                    //std::cout<<"X1 "<<pMeasureArray[k].x<<" Y1 "<<pMeasureArray[k].y<<" X2 "
-                    //  <<i<<" Y2 "<<j<<" dist  "<<dist<<std::endl;
-                    //std::cout<<"dist from "<<pMeasureArray[k].x<<" "<<pMeasureArray[k].y<<" is:"<<dist;
-                    //std::cout<<" prob:"<<pMeasureArray[k].probabilityEdge<<std::endl;
-                    }
-                }//for(k = 0; k < NUMBER_OF_PARTICLES; ++k)
-            }//if (QColor(image.pixel(i, j)) != QColor(Qt::black))
-        }//for(j = height/2; j < height; ++j)
+                //vehicle turned left, so the road turns right around it
+                x = road.getX() - predictDistance;
+                y = road.getY();
+                image = RCS2IPCS(Point3D(predictCos*x + predictSin*y, -predictSin*x + predictCos*y, 0.0));
+                particles.x[k] = image.getX();
+                particles.y[k] = image.getY();
+            }
+            particles.x[k] += processNoiseX * r.normal();
+            particles.y[k] += processNoiseY * r.normal();
+
+            //left the frame or passed under the camera, start it again
+            //anywhere like scatter() does. Updates multiply weights, so it
+            //gets the mean weight of a normalized set rather than 0, which
+            //no update or resample could ever raise again.
+            if (particles.x[k] < 0 || particles.x[k] > FRAME_WIDTH ||
+                particles.y[k] < 0 || particles.y[k] > FRAME_HEIGHT)
+            {
+                particles.x[k] = r.uniformInt(0, FRAME_WIDTH);
+                particles.y[k] = r.uniformInt(0, FRAME_HEIGHT);
+                particles.weight[k] = 1.0 / particleCount;
+            }
+        }
     }
-    printParticles("Measure update");
+}
+
+//scale weights to sum 1 and measure how degenerate they are. When every
+//weight vanished no particle explains the frame, restart from uniform.
+void particleFilter::normalize()
+{
+    float total = sumOf(particles.weight, particleCount);
+    health.reset = total <= 0.0;
+    if (health.reset)
+    {
+        VERBOSE_LOG("no particle supported, weights reset");
+        fill(particles.weight, particleCount, 1.0 / particleCount);
+    }
+    else
+      scaleBy(particles.weight, particleCount, 1.0 / total);
+
+    double squares = 0.0;
+    double entropy = 0.0;
+    float w;
+    for(int k = 0; k < particleCount; ++k)
+    {
+        w = particles.weight[k];
+        squares += w * w;
+        if (w > 0.0)
+          entropy -= w * log(w);
+    }
+    health.ess = squares > 0.0 ? 1.0 / squares : 0.0;
+    health.maxWeight = maxOf(particles.weight, particleCount);
+    health.entropy = entropy;
+    health.resampled = false;
+    //evidence that can't tell particles apart doesn't confirm the track
+    health.lost = health.reset || health.ess > lostThreshold * particleCount;
+}
+
+void particleFilter::setResampleThreshold(const float fraction)
+{
+    Q_ASSERT(fraction >= 0.0);
+    resampleThreshold = fraction;
+}
+
+void particleFilter::setLostThreshold(const float fraction)
+{
+    Q_ASSERT(fraction > 0.0);
+    lostThreshold = fraction;
 }
 
 void particleFilter::resample()
 {
     //std::cout<<"resample"<<std::endl;
-    int index = randomInt(0, NUMBER_OF_PARTICLES);
-    M_Prob* newProbArray;
-    try{
-        newProbArray = new M_Prob[NUMBER_OF_PARTICLES];
+    if (!particles.x || !spare.x)
+      return;
+
+    //no particle has support, every resampler would collapse the set onto
+    //whatever index it starts from, keep particles as they are
+    float total = sumOf(particles.weight, particleCount);
+    if (total <= 0.0)
+      return;
+
+    //weights still spread over enough particles, keep their diversity
+    if (!resampleDue())
+      return;
+
+    health.resampled = true;
+    if (adaptive)
+    {
+        kldResample();
+        std::swap(particles, spare);
+        VERBOSE_LOG("active particles:"<<particleCount);
+        fill(particles.weight, particleCount, 1.0 / particleCount);
+        resetHealth();
+        return;
     }
-    catch (std::bad_alloc& ba)
+
+    switch (resampleMethod)
     {
-        std::cerr<<"bad_alloc caught:"<<ba.what()<<std::endl;
+      case RESAMPLE_WHEEL:
+        wheelResample();
+      break;
+      case RESAMPLE_STRATIFIED:
+        lowVarianceResample(total, true);
+      break;
+      case RESAMPLE_SYSTEMATIC:
+      default:
+        lowVarianceResample(total, false);
+      break;
     }
 
-    float maxProb = 0.0;
+    //new set is in the back buffer, swap instead of copying it back
+    std::swap(particles, spare);
+    //drawn particles represent the posterior equally
+    fill(particles.weight, particleCount, 1.0 / particleCount);
+    resetHealth();
+    printParticles("Resample");
+}
+
+//uniform weights after resample(), so a following frame without evidence
+//doesn't pass the ESS gate again. lost keeps the last measurement's verdict.
+void particleFilter::resetHealth()
+{
+    health.ess = particleCount;
+    health.maxWeight = 1.0 / particleCount;
+    health.entropy = log(static_cast<double>(particleCount));
+}
+
+//resampling wheel from CS373, O(N) amortized but random step per particle
+void particleFilter::wheelResample()
+{
+    int index = random.uniformInt(0, particleCount - 1);
+    float maxProb = maxOf(particles.weight, particleCount);
     float beta = 0.0;
     int i;
-    for(i = 0; i < NUMBER_OF_PARTICLES; ++i)
+
+    //std::cout<<"maxProb: "<<maxProb<<std::endl;
+    for(i = 0; i < particleCount; ++i)
     {
-        if (pMeasureArray[i].probability > maxProb )
-          maxProb = pMeasureArray[i].probability;
+        beta += random.uniform() * 2.0 * maxProb;
+        while (beta > particles.weight[index])
+        {
+            beta -= particles.weight[index];
+            index = (index + 1) % particleCount;
+        }
+        spare.x[i] = particles.x[index];
+        spare.y[i] = particles.y[index];
+        spare.weight[i] = particles.weight[index];
     }
+}
 
-    //std::cout<<"maxProb: "<<maxProb<<std::endl;
-    //resample
-    for(i = 0; i < NUMBER_OF_PARTICLES; ++i)
-    {
-        beta += (static_cast<float>(randomInt(0, 100))/100.0) * 2.0 * maxProb;
-        //beta += (static_cast<float>(randomInt(0, 100))/100.0) * 2.0 * maxProb;
-        //std::cout<<"index "<<index<<" beta: "<<beta;
-        //std::cout<<" prob:"<<pMeasureArray[index].probabilityEdge<<std::endl;
-        while (beta > pMeasureArray[index].probability)
+//low variance resampling, one pass over the cumulative weights.
+//systematic: pointers (u + i) * total / N with a single u in [0, 1)
+//stratified: pointers (u_i + i) * total / N with a fresh u_i per stratum
+void particleFilter::lowVarianceResample(const float total, const bool stratified)
+{
+    const double step = static_cast<double>(total) / particleCount;
+    double u = random.uniform();
+    double cumulative = particles.weight[0];
+    double pointer;
+    int i, j = 0;
+    for(i = 0; i < particleCount; ++i)
+    {
+        if (stratified && i > 0)
+          u = random.uniform();
+        pointer = (i + u) * step;
+        //float rounding may leave the last pointer past the total
+        while (pointer > cumulative && j < particleCount - 1)
         {
-            beta -= pMeasureArray[index].probability;
-            //std::cout<<"--->reinit:"<<index<<std::endl;
+            ++j;
+            cumulative += particles.weight[j];
+        }
+        spare.x[i] = particles.x[j];
+        spare.y[i] = particles.y[j];
+        spare.weight[i] = particles.weight[j];
+    }
+}
 
-            //this particle have to be resampled
-            //pMeasureArray[index].x = randomInt(0, 1600);
-            //pMeasureArray[index].y = randomInt(0, 1200);
-            //pMeasureArray[index].probabilityEdge = 0.0;
+//number of particles that bounds, with probability 1 - delta, KL divergence
+//between sample based and true posterior by epsilon, k is occupied bins.
+//Wilson-Hilferty approximation of the chi-square quantile, z = z(1 - delta)
+static int kldBound(const int k, const float epsilon, const float z)
+{
+    double a = 2.0 / (9.0 * (k - 1));
+    double b = 1.0 - a + sqrt(a) * z;
+    return static_cast<int>(ceil((k - 1) / (2.0 * epsilon) * b * b * b));
+}
 
-            index = (index + 1) % NUMBER_OF_PARTICLES;
-        }
-        //std::cout<<"index:"<<index<<" kept"<<std::endl;
-        newProbArray[i] = pMeasureArray[index]; 
+//KLD-sampling (Fox 2003): draw particles one by one and count histogram
+//bins they fall into, stop once the count reaches the bound for that many
+//bins. A tight posterior fills few bins and stops early, a spread one grows
+//towards maxParticles.
+void particleFilter::kldResample()
+{
+    int i, j, bin;
+    double sum = 0.0;
+    for(i = 0; i < particleCount; ++i)
+    {
+        sum += particles.weight[i];
+        cumulative[i] = sum;
     }
 
-    for(i = 0; i < NUMBER_OF_PARTICLES; ++i)
+    //new stamp marks every bin empty without clearing the grid
+    if (++binStamp == INT_MAX)
     {
-        pMeasureArray[i] = newProbArray[i]; 
+        binStamps.assign(binStamps.size(), 0);
+        binStamp = 1;
     }
 
-    delete[] newProbArray;
-    printParticles("Resample");
+    float* end = cumulative + particleCount;
+    int bins = 0;
+    int required = minParticles;
+    int n = 0;
+    while (n < maxParticles && n < required)
+    {
+        j = std::upper_bound(cumulative, end, static_cast<float>(random.uniform() * sum)) - cumulative;
+        j = qMin(j, particleCount - 1);
+        spare.x[n] = particles.x[j];
+        spare.y[n] = particles.y[j];
+        spare.weight[n] = particles.weight[j];
+
+        bin = qBound(0, static_cast<int>(spare.y[n]) / kldBinSize, binRows - 1) * binCols +
+              qBound(0, static_cast<int>(spare.x[n]) / kldBinSize, binCols - 1);
+        ++n;
+        if (binStamps[bin] != binStamp)
+        {
+            binStamps[bin] = binStamp;
+            if (++bins > 1)
+              required = qMax(minParticles, kldBound(bins, kldEpsilon, kldZ));
+        }
+    }
+    particleCount = n;
 }
 
 void particleFilter::printParticles(const char* header)
 {
 #if 0
     if (header)
-      std::cout<<*header<<std::endl;
+      std::cout<<header<<std::endl;
     int i = 0;
     float sum = 0.0;
-    while (i<NUMBER_OF_PARTICLES)
+    while (i<particleCount)
     {
-        sum +=pMeasureArray[i].probabilityEdge;
+        sum += particles.weight[i];
         ++i;
     }
 
     i = 0;
-    while (i<NUMBER_OF_PARTICLES)
-    {
-        std::cout<<pMeasureArray[i].x<<" "
-                 <<pMeasureArray[i].y<<" "
-                 <<pMeasureArray[i].probabilityEdge<<" "
-                 <<(pMeasureArray[i].probabilityEdge/sum) * 100.0<<"% "
-                 //<<pMeasureArray[i].probabilityMarker<<" "
-                 //<<pMeasureArray[i].probabilityRoad<<" "
-                 //<<pMeasureArray[i].probabilityNonRoad
+    while (i<particleCount)
+    {
+        std::cout<<particles.x[i]<<" "
+                 <<particles.y[i]<<" "
+                 <<particles.weight[i]<<" "
+                 <<(particles.weight[i]/sum) * 100.0<<"% "
                  <<std::endl;
         ++i;
     }
     std::cout<<"\n==========END=========="<<std::endl;
+#else
+    (void)header;
 #endif
 }
 
 void particleFilter::move(const int pixels)
 {
-    for(int i = 0; i < NUMBER_OF_PARTICLES; ++i)
-    {
-        pMeasureArray[i].y += pixels; 
-    }
+    addTo(particles.y, particleCount, pixels);
 }
@@ -19,78 +19,306 @@
 #ifndef NAVPRO_PARTICLEfILTER_H_
 #define NAVPRO_PARTICLEfILTER_H_
 
+#include <vector>
 #include <QImage>
+#include <QRunnable>
+#include <QSemaphore>
 
 #include <opencv2/core/core.hpp>
 
 #include "environment.h"
+#include "likelihoodTable.h"
+#include "roadColorModel.h"
+#include "randomGenerator.h"
 
 
-static int randomInt(const int low, const int high)
-{
-    Q_ASSERT(high > low);
-    return qrand()%((high + 1) - low) + low;
-}
-
 static int Distance(const int X1, const int Y1, const int X2, const int Y2)
 {                        
     return static_cast<int>(sqrt(pow((X1-X2), 2) + pow((Y1-Y2), 2)));
 }
 
 
-struct measurement
+//structure-of-arrays particle storage, x[i], y[i] and weight[i] describe
+//particle i. Every array is 16-byte aligned so SIMD kernels can stream them.
+struct particleSet
 {
-  unsigned int x;
-  unsigned int y;
-  float probability;
-
-  measurement()
-    : x(randomInt(0, FRAME_WIDTH)),
-    y(randomInt(0, FRAME_HEIGHT)),
-    probability(0.0)
+  float* x;
+  float* y;
+  float* weight;
+
+  particleSet()
+    : x(NULL),
+    y(NULL),
+    weight(NULL)
   {
   }
+};
+
+//weight distribution after last measurement update, weights sum to 1
+struct filterHealth
+{
+  //effective sample size 1 / sum(w^2), particle count when uniform
+  float ess;
+  float maxWeight;
+  //-sum(w * log(w)), log(particle count) when uniform
+  float entropy;
+  //resample() ran since last measurement update
+  bool resampled;
+  //every weight vanished and normalize() restarted from uniform
+  bool reset;
+  //measurement didn't single out part of the set, see setLostThreshold()
+  bool lost;
 
-  measurement& operator= (const measurement& M)
+  filterHealth()
+    : ess(0.0),
+    maxWeight(0.0),
+    entropy(0.0),
+    resampled(false),
+    reset(false),
+    lost(true)
   {
-      this->x = M.x;
-      this->y = M.y;
-      this->probability = M.probability;
-      return *this;
   }
 };
 
-typedef measurement M_Prob;
-
 class particleFilter
 {
   public:
     const static int NUMBER_OF_PARTICLES = 1000;
+    // smallest particle block worth handing to another thread, also the
+    // chunk of particles drawing from one random stream
+    const static int MIN_BLOCK_SIZE = 256;
+    const static quint64 DEFAULT_SEED = 1;
+    // added to road probability before its log in fused update
+    static const float COLOR_FLOOR;
 
     enum {
       EDGE = 0,
       LANE_MARKER,
-      COLOR
+      COLOR,
+      NUMBER_OF_CUES
+    };
+
+    // how measurementUpdate(const QImage&) finds nearest feature of particle
+    enum {
+      // compare every particle against every feature pixel
+      EXHAUSTIVE_SEARCH = 0,
+      // look up one distance transform map per frame
+      DISTANCE_TRANSFORM
     };
 
-    particleFilter();
+    // resample() methods, low variance ones are O(N) with no search
+    enum {
+      // resampling wheel from CS373
+      RESAMPLE_WHEEL = 0,
+      // one random offset, evenly spaced pointers
+      RESAMPLE_SYSTEMATIC,
+      // one random offset per pointer stratum
+      RESAMPLE_STRATIFIED
+    };
+
+    explicit particleFilter(const int count = NUMBER_OF_PARTICLES);
     ~particleFilter();
+    // resample only when ESS < fraction * particle count, 0 never and
+    // above 1 every call
     void resample();
-    // update road color cue
-    void measurementUpdate(const std::vector<cv::Mat>& rgbHistogram, const QImage& rawImage);
-    // update road edge cue
+    void setResampleThreshold(const float fraction);
+    // ESS gate of resample() on current health
+    bool resampleDue() const { return health.ess < resampleThreshold * particleCount; }
+    // track is lost when a measurement leaves ESS above fraction * particle
+    // count, weights nearly uniform, or when no particle had support
+    void setLostThreshold(const float fraction);
+    bool isLost() const { return health.lost; }
+    const filterHealth& getHealth() const { return health; }
+    // update road color cue, road probability of each pixel comes from
+    // model's RGB table
+    void measurementUpdate(const roadColorModel& model, const QImage& rawImage);
+    // same on a CV_8UC4 BGRA, CV_8UC3 BGR or CV_8UC1 gray frame such as
+    // videoFrame::mat(), read in place
+    void measurementUpdate(const roadColorModel& model, const cv::Mat& rawImage);
+    // update road edge cue, feature pixels are the non-black ones
     void measurementUpdate(const QImage&, bool grayImage = false);
-    const M_Prob* getParticles() { return pMeasureArray;}
+    // same on an 8-bit mask such as Canny output, feature pixels are
+    // non-zero. Mask is read in place, nothing is converted.
+    void measurementUpdate(const cv::Mat& featureMask);
+    // fused cues (Apostoloff): every particle weight is multiplied by
+    // exp(sum of cue weight * log likelihood). Edge and marker likelihoods
+    // come from distance to nearest feature, colour from road probability
+    // under the particle. Weights stay logs until the largest is
+    // subtracted, so far cues can't underflow every particle to 0.
+    void measurementUpdate(const QImage& edgeImage, const QImage& markerImage,
+                           const roadColorModel& model, const QImage& rawImage);
+    // fused update on CV_8UC1 edge and marker masks, rawImage as in the
+    // colour update above
+    void measurementUpdate(const cv::Mat& edgeMask, const cv::Mat& markerMask,
+                           const roadColorModel& model, const cv::Mat& rawImage);
+    // road probability of every pixel from last colour update, CV_32F
+    const cv::Mat& getColorProbability() const { return colorProbability; }
+    // distance to nearest feature of cue from last update, CV_32F, empty
+    // when cue had no feature. Single cue updates fill EDGE slot.
+    const cv::Mat& getDistanceMap(const int cue) const { return distanceMaps[cue]; }
+    // exponent of cue's likelihood in fused update, 1 for plain product
+    void setCueWeight(const int cue, const float weight);
+    const particleSet* getParticles() const { return &particles;}
     void move(const int pixels);
+    // add N(0, sigma) noise to every particle
+    void diffuse(const float sigmaX, const float sigmaY);
+    // motion model: vehicle drove speed * interval meters and turned
+    // yawRate * interval radians (left positive) since last frame. Each
+    // particle follows the road point under it, gets process noise, and is
+    // scattered again at weight 1/N once it leaves the frame.
+    void predict(const float speed, const float yawRate, const float interval);
+    // sigma in pixels of predict() noise
+    void setProcessNoise(const float sigmaX, const float sigmaY);
+    // reseed all random streams and scatter particles again
+    void seed(const quint64 value);
+    void setMeasureMode(const int mode) { measureMode = mode; }
+    void setResampleMethod(const int method) { resampleMethod = method; }
+    // number of particles currently in use, varies when adaptive
+    int getParticleCount() const { return particleCount; }
+    // KLD-sampling, resample() keeps count within [minCount, maxCount]
+    void enableAdaptive(const int minCount, const int maxCount);
+    void disableAdaptive();
+    // epsilon: max KL divergence, z: upper 1-delta normal quantile,
+    // binSize: histogram bin edge in pixels
+    void setKldParameters(const float epsilon, const float z, const int binSize);
+    // sigma of distance likelihood, rebuilds the table when it changes
+    void setNoise(const float noise);
+    float getNoise() const { return globleNoise; }
+    // distance -> likelihood table for current noise, shareable by other cues
+    const likelihoodTable& getLikelihoodTable() const { return gaussian; }
+    // limit feature scans and colour map to region, empty rect for the
+    // whole frame. Outside it there is no feature and no road.
+    void setRegion(const cv::Rect& rect) { region = rect; }
+    // bounding box of weighted particles grown by margin and clipped to
+    // the frame, false while isLost()
+    bool getTrackRect(const int margin, cv::Rect& rect) const;
+    // max threads sharing a measurement update, 1 runs it serially
+    void setThreadCount(const int count) { threadCount = qMax(1, count); }
 
   private:
     particleFilter            (const particleFilter &);
     particleFilter& operator= (const particleFilter &);
 
     void printParticles(const char* header = NULL);
+    class blockTask;
+
+    // work a blockTask runs
+    enum {
+      MEASURE_JOB = 0,
+      COLOR_JOB,
+      FUSE_JOB,
+      EXP_JOB,
+      DIFFUSE_JOB,
+      PREDICT_JOB
+    };
+
+    cv::Rect activeRegion(const int width, const int height) const;
+    // particle k may index a map of (frameWidth + 1) x (frameHeight + 1).
+    // Coordinates are float, so negative ones must be rejected explicitly,
+    // and the positive form of the test rejects NaN too.
+    bool onFrame(const int k) const
+    {
+        return particles.x[k] >= 0 && particles.x[k] <= frameWidth &&
+               particles.y[k] >= 0 && particles.y[k] <= frameHeight;
+    }
+    static void toMask(const QImage& image, cv::Mat& mask);
+    static cv::Mat toBgra(const QImage& image, QImage& rgb);
+    bool collectFeatures(const cv::Mat& mask);
+    bool buildDistanceMap(const cv::Mat& mask, cv::Mat& distanceMap);
+    bool buildColorProbability(const roadColorModel& model, const cv::Mat& rawImage);
+    void scatter();
+    void runBlocks(const int job);
+    void runBlock(const int job, const int begin, const int end);
+    void measureBlock(const int begin, const int end);
+    void diffuseBlock(const int begin, const int end);
+    void predictBlock(const int begin, const int end);
+    void exhaustiveBlock(const int begin, const int end);
+    void colorBlock(const int begin, const int end);
+    void fuseBlock(const int begin, const int end);
+    void expBlock(const int begin, const int end);
+    void distanceBlock(const int begin, const int end);
+    bool reserve(const int n);
+    void normalize();
+    void wheelResample();
+    void kldResample();
+    void lowVarianceResample(const float total, const bool stratified);
+    void resetHealth();
     //pointer to robot
     float globleNoise;
-    M_Prob* pMeasureArray;
+    //Gaussian(d, globleNoise, 0) for integer distance d
+    likelihoodTable gaussian;
+    int particleCount;
+    //particles every buffer can hold
+    int capacity;
+    particleSet particles;
+    //resample() writes here then swaps with particles, never reallocated
+    particleSet spare;
+    int measureMode;
+    int resampleMethod;
+    //per particle likelihood of current frame, scratch for SIMD kernels
+    float* likelihood;
+    //running weight sum for kldResample(), shares likelihood's block
+    float* cumulative;
+
+    //KLD-sampling state
+    bool adaptive;
+    int minParticles;
+    int maxParticles;
+    float kldEpsilon;
+    float kldZ;
+    int kldBinSize;
+    int binCols;
+    int binRows;
+    //bin is occupied in current resample when its stamp equals binStamp
+    std::vector<int> binStamps;
+    int binStamp;
+
+    //feature pixels are 0, reused between frames
+    cv::Mat featureMap;
+    //non-black pixels of QImage cues, reused between frames
+    cv::Mat imageMasks[NUMBER_OF_CUES];
+    //distance to nearest feature pixel of each cue, CV_32F. Single cue
+    //updates use slot 0.
+    cv::Mat distanceMaps[NUMBER_OF_CUES];
+    //cue has features in current fused update
+    bool cueActive[NUMBER_OF_CUES];
+    float cueWeights[NUMBER_OF_CUES];
+    //road probability of every raw image pixel, reused between frames
+    cv::Mat colorProbability;
+    //setRegion(), empty for whole frame
+    cv::Rect region;
+    //feature pixels for EXHAUSTIVE_SEARCH
+    std::vector<cv::Point> features;
+
+    //parallel measurement update
+    int threadCount;
+    std::vector<blockTask*> tasks;
+    QSemaphore blocksDone;
+    //size of image being measured
+    int frameWidth;
+    int frameHeight;
+
+    quint64 seedValue;
+    //stream 0, used by serial steps: scatter and resample
+    randomGenerator random;
+    //stream c + 1 belongs to particles [c, c + 1) * MIN_BLOCK_SIZE
+    std::vector<randomGenerator> chunkRandom;
+    float diffuseSigmaX;
+    float diffuseSigmaY;
+    //largest fused log weight, expBlock() scales by it
+    float fuseMaxLog;
+    //predict() state, ego-motion of current step and its noise
+    float predictDistance;
+    float predictCos;
+    float predictSin;
+    float processNoiseX;
+    float processNoiseY;
+
+    //ESS gate of resample(), fraction of particle count
+    float resampleThreshold;
+    //ESS above this fraction of particle count means track lost
+    float lostThreshold;
+    filterHealth health;
 };
 
 #endif //NAVPRO_PARTICLEfILTER_H_
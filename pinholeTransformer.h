@@ -31,12 +31,24 @@ class pinholeTransformer
 {
   public:
 
+//Camera looks along X, Y is to the left and Z up, image u grows to the
+//right and v grows down, (x, y) is the principal point.
+//
+//     | F*fx  0   |   | -Y |   | x |
+//Pi = |           | * |    | + |   | * 1/X
+//     |  0   F*fy |   | -Z |   | y |
+//
+//A point on or behind the image plane (X <= 0) has no projection, it is
+//returned at (-1, -1), which is outside every image.
     static Point translation(const float F, const float fx, const float fy, const float x, const float y, const HomoPoint3D& PA)
     {
-        //Pi is 3-D vector, should eventually downgrade to 2-D
-        Point3D Pi = Point3D((x*PA.getX() - fx*PA.getY())/F, (y*PA.getX() - fy*PA.getY())/F, PA.getX()/F);
+        if (PA.getX() <= 0.0)
+          return Point(-1.0, -1.0);
 
-        return Point(Pi.getX(), Pi.getY());
+        //Pi is 3-D vector, downgrade to 2-D by dividing by depth
+        Point3D Pi = Point3D(x*PA.getX() - F*fx*PA.getY(), y*PA.getX() - F*fy*PA.getZ(), PA.getX());
+
+        return Point(Pi.getX()/Pi.getZ(), Pi.getY()/Pi.getZ());
     }
 };
 
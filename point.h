@@ -66,6 +66,7 @@ class Point3D : public Point
 
     Point3D& operator= (const Point3D& P)
     {
+        Point::operator=(P);
         this->z_ = P.z_;
 
         return *this;
@@ -96,6 +97,7 @@ struct HomoPoint3D : public Point3D
 
     HomoPoint3D& operator= (const HomoPoint3D& P)
     {
+        Point3D::operator=(P);
         this->homo_ = P.homo_;
 
         return *this;
@@ -105,7 +107,7 @@ struct HomoPoint3D : public Point3D
     float homo_;
 };
 
-HomoPoint3D operator+ (const HomoPoint3D& PA, const HomoPoint3D& PB)
+inline HomoPoint3D operator+ (const HomoPoint3D& PA, const HomoPoint3D& PB)
 {
     return HomoPoint3D(PA.getX() + PB.getX(),
                        PA.getY() + PB.getY(),
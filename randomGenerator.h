@@ -0,0 +1,126 @@
+/*=============================================================================
+**                            MODULE SPECIFICATION
+===============================================================================
+**
+**  Title : Random number generator for particle filters
+**
+**  Description : PCG32 (O'Neill, "PCG: A Family of Simple Fast Space-Efficient
+**                Statistically Good Algorithms for Random Number Generation")
+**                64-bit state, 32-bit output, selectable stream. Generators
+**                with the same seed but different streams are independent,
+**                so every worker can own one and results don't depend on
+**                thread scheduling.
+**
+**                http://www.pcg-random.org/
+**
+===============================================================================
+**  Author            :     Xin Zhang
+**  Creation Date     :     2013.06.04
+===============================================================================
+**/
+
+#ifndef NAVPRO_RANDOM_GENERATOR_H_
+#define NAVPRO_RANDOM_GENERATOR_H_
+
+#include <cmath>
+#include <QtGlobal>
+
+#include "environment.h"
+
+class randomGenerator
+{
+  public:
+    explicit randomGenerator(const quint64 seedValue = 1, const quint64 stream = 0)
+    {
+        seed(seedValue, stream);
+    }
+
+    void seed(const quint64 seedValue, const quint64 stream = 0)
+    {
+        state_ = 0;
+        inc_ = (stream << 1) | 1;
+        next();
+        state_ += seedValue;
+        next();
+        hasSpare_ = false;
+    }
+
+    // uniform 32 bits
+    quint32 next()
+    {
+        quint64 old = state_;
+        state_ = old * 6364136223846793005ULL + inc_;
+        quint32 xorshifted = static_cast<quint32>(((old >> 18) ^ old) >> 27);
+        quint32 rot = static_cast<quint32>(old >> 59);
+        return (xorshifted >> rot) | (xorshifted << ((-rot) & 31));
+    }
+
+    // uniform float in [0, 1), 24 random bits
+    float uniform()
+    {
+        return (next() >> 8) * (1.0f / 16777216.0f);
+    }
+
+    // uniform int in [low, high], no modulo bias (Lemire's multiply-shift)
+    int uniformInt(const int low, const int high)
+    {
+        Q_ASSERT(high >= low);
+        quint32 range = static_cast<quint32>(high - low) + 1;
+        quint64 m = static_cast<quint64>(next()) * range;
+        quint32 l = static_cast<quint32>(m);
+        if (l < range)
+        {
+            quint32 threshold = (0u - range) % range;
+            while (l < threshold)
+            {
+                m = static_cast<quint64>(next()) * range;
+                l = static_cast<quint32>(m);
+            }
+        }
+        return low + static_cast<int>(m >> 32);
+    }
+
+    // standard normal, Marsaglia polar method, second value cached
+    float normal()
+    {
+        if (hasSpare_)
+        {
+            hasSpare_ = false;
+            return spare_;
+        }
+
+        float u, v, s;
+        do {
+            u = 2.0f * uniform() - 1.0f;
+            v = 2.0f * uniform() - 1.0f;
+            s = u * u + v * v;
+        } while (s >= 1.0f || s == 0.0f);
+
+        float factor = std::sqrt(-2.0f * std::log(s) / s);
+        spare_ = v * factor;
+        hasSpare_ = true;
+        return u * factor;
+    }
+
+    // batched versions fill out[0, n)
+    void uniform(float* out, const int n, const float low = 0.0f, const float high = 1.0f)
+    {
+        const float scale = high - low;
+        for(int i = 0; i < n; ++i)
+          out[i] = low + scale * uniform();
+    }
+
+    void normal(float* out, const int n, const float mean = 0.0f, const float sigma = 1.0f)
+    {
+        for(int i = 0; i < n; ++i)
+          out[i] = mean + sigma * normal();
+    }
+
+  private:
+    quint64 state_;
+    quint64 inc_;
+    bool hasSpare_;
+    float spare_;
+};
+
+#endif  //NAVPRO_RANDOM_GENERATOR_H_
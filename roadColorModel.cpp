@@ -0,0 +1,173 @@
+/*=============================================================================
+**                            MODULE SPECIFICATION
+===============================================================================
+**
+**  Title : Road colour model
+**
+**  Description : Incremental, exponentially decayed joint CrCb histogram
+**                and its RGB lookup table, see roadColorModel.h
+**
+**
+===============================================================================
+**  Author            :     Xin Zhang
+**  Creation Date     :     2013.06.22
+===============================================================================
+**/
+
+#include <cstring>
+#include <iostream>
+#include "roadColorModel.h"
+
+const float roadColorModel::DEFAULT_FORGETTING = 0.9;
+
+//chroma of 8 bits to joint histogram bin
+#define CHROMA_BIN(CR, CB) \
+        ((((CR) >> (8 - CHROMA_BITS)) << CHROMA_BITS) | ((CB) >> (8 - CHROMA_BITS)))
+
+roadColorModel::roadColorModel()
+  : forgetting_(DEFAULT_FORGETTING),
+    step_(DEFAULT_STEP),
+    samples_(0),
+    started_(false)
+{
+  reset();
+}
+
+roadColorModel::~roadColorModel()
+{
+}
+
+//RGB2CR and RGB2CB as 16.16 fixed point, one 256 entry table per channel,
+//R table carries the +128 offset. Cr tables first, then Cb.
+const int* roadColorModel::chromaTables()
+{
+  static int tables[2 * 3 * 256];
+  static bool built = false;
+  if (!built)
+  {
+    const double cr[3] = {0.439, -0.368, -0.071};
+    const double cb[3] = {-0.148, -0.291, 0.439};
+    for (int c = 0; c < 3; ++c)
+    {
+      for (int v = 0; v < 256; ++v)
+      {
+        tables[c * 256 + v] = qRound(((c == 0 ? 128.0 : 0.0) + cr[c] * v) * 65536.0);
+        tables[(3 + c) * 256 + v] = qRound(((c == 0 ? 128.0 : 0.0) + cb[c] * v) * 65536.0);
+      }
+    }
+    built = true;
+  }
+  return tables;
+}
+
+void roadColorModel::reset()
+{
+  memset(joint_, 0, sizeof(joint_));
+  started_ = false;
+  publish();
+}
+
+void roadColorModel::setForgetting(const float forgetting)
+{
+  Q_ASSERT(forgetting >= 0.0 && forgetting < 1.0);
+  forgetting_ = forgetting;
+}
+
+void roadColorModel::setStep(const int step)
+{
+  Q_ASSERT(step > 0);
+  step_ = step;
+}
+
+void roadColorModel::update(const cv::Mat& bgr, const cv::Rect& area, const cv::Mat& roadMask)
+{
+  Q_ASSERT(bgr.type() == CV_8UC3);
+  Q_ASSERT(roadMask.empty() || (roadMask.type() == CV_8UC1 && roadMask.size() == bgr.size()));
+
+  const int* crTable = chromaTables();
+  const int* cbTable = crTable + 3 * 256;
+  const cv::Rect frame = area & cv::Rect(0, 0, bgr.cols, bgr.rows);
+
+  memset(counts_, 0, sizeof(counts_));
+  samples_ = 0;
+
+  const uchar* pixel;
+  const uchar* mask = NULL;
+  int x, y, b, g, r;
+  for (y = frame.y; y < frame.y + frame.height; y += step_)
+  {
+    pixel = bgr.ptr(y);
+    if (!roadMask.empty())
+      mask = roadMask.ptr(y);
+    for (x = frame.x; x < frame.x + frame.width; x += step_)
+    {
+      if (mask && !mask[x])
+        continue;
+      b = pixel[3 * x];
+      g = pixel[3 * x + 1];
+      r = pixel[3 * x + 2];
+      ++counts_[CHROMA_BIN((crTable[r] + crTable[256 + g] + crTable[512 + b]) >> 16,
+                           (cbTable[r] + cbTable[256 + g] + cbTable[512 + b]) >> 16)];
+      ++samples_;
+    }
+  }
+
+  //nothing believed to be road this frame, keep what the model knows
+  if (samples_ == 0)
+    return;
+
+  //3x3 [1 2 1] over neighbouring bins stands in for blurring the planes,
+  //then blend frame into the model
+  const float frameWeight = started_ ? 1.0 - forgetting_ : 1.0;
+  const float keep = started_ ? forgetting_ : 0.0;
+  const float scale = frameWeight / (16.0 * samples_);
+  const int weights[3] = {1, 2, 1};
+  int cr, cb, i, j, sum;
+  for (cr = 0; cr < CHROMA_BINS; ++cr)
+  {
+    for (cb = 0; cb < CHROMA_BINS; ++cb)
+    {
+      sum = 0;
+      for (i = -1; i <= 1; ++i)
+        for (j = -1; j <= 1; ++j)
+          sum += weights[i + 1] * weights[j + 1] *
+                 counts_[qBound(0, cr + i, CHROMA_BINS - 1) * CHROMA_BINS +
+                         qBound(0, cb + j, CHROMA_BINS - 1)];
+      joint_[cr * CHROMA_BINS + cb] = keep * joint_[cr * CHROMA_BINS + cb] + scale * sum;
+    }
+  }
+  started_ = true;
+  publish();
+}
+
+//look every quantized colour's chroma up in the joint histogram once,
+//scaled so the most road-like bin is 1
+void roadColorModel::publish()
+{
+  float max = 0.0;
+  int i;
+  for (i = 0; i < CHROMA_BINS * CHROMA_BINS; ++i)
+    max = qMax(max, joint_[i]);
+  const float scale = max > 0.0 ? 1.0 / max : 0.0;
+
+  const int* crTable = chromaTables();
+  const int* cbTable = crTable + 3 * 256;
+  //centre of each colour cell
+  const int half = 1 << (7 - RGB_BITS);
+  int r, g, b, rv, gv, bv;
+  float* out = rgbTable_;
+  for (r = 0; r < RGB_BINS; ++r)
+  {
+    rv = (r << (8 - RGB_BITS)) + half;
+    for (g = 0; g < RGB_BINS; ++g)
+    {
+      gv = (g << (8 - RGB_BITS)) + half;
+      for (b = 0; b < RGB_BINS; ++b)
+      {
+        bv = (b << (8 - RGB_BITS)) + half;
+        *out++ = scale * joint_[CHROMA_BIN((crTable[rv] + crTable[256 + gv] + crTable[512 + bv]) >> 16,
+                                           (cbTable[rv] + cbTable[256 + gv] + cbTable[512 + bv]) >> 16)];
+      }
+    }
+  }
+}
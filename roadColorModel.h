@@ -0,0 +1,94 @@
+/*=============================================================================
+**                            MODULE SPECIFICATION
+===============================================================================
+**
+**  Title : Road colour model
+**
+**  Description : Joint, quantized CrCb histogram of road pixels kept across
+**                frames. Each update folds in one frame's histogram with an
+**                exponential forgetting factor, sampled on a sparse grid
+**                and optionally only where a road mask is set, then
+**                rebuilds an RGB -> road probability table so the per
+**                pixel colour cue is one load.
+**
+**
+===============================================================================
+**  Author            :     Xin Zhang
+**  Creation Date     :     2013.06.22
+===============================================================================
+**/
+
+#ifndef NAVPRO_ROAD_COLOR_MODEL_H_
+#define NAVPRO_ROAD_COLOR_MODEL_H_
+
+#include <vector>
+#include <opencv2/core/core.hpp>
+
+#include "environment.h"
+
+class roadColorModel
+{
+  public:
+    // bits kept of Cr and Cb, joint histogram is 2^CHROMA_BITS squared
+    const static int CHROMA_BITS = 5;
+    const static int CHROMA_BINS = 1 << CHROMA_BITS;
+    // bits kept of R, G and B in the probability table
+    const static int RGB_BITS = 5;
+    const static int RGB_BINS = 1 << RGB_BITS;
+    // weight kept by the model per update, the frame gets 1 - forgetting
+    static const float DEFAULT_FORGETTING;
+    // sample every DEFAULT_STEP pixel in x and y
+    const static int DEFAULT_STEP = 4;
+
+    roadColorModel();
+    ~roadColorModel();
+
+    // fold area of a BGR frame into the model. Only grid pixels inside
+    // area, and non-zero in roadMask when it is given, are sampled; without
+    // any such pixel the model stays as it is.
+    void update(const cv::Mat& bgr, const cv::Rect& area, const cv::Mat& roadMask = cv::Mat());
+    // forget everything, next update starts the model again
+    void reset();
+    void setForgetting(const float forgetting);
+    void setStep(const int step);
+    // pixels sampled by last update
+    int getSampleCount() const { return samples_; }
+
+    // road probability of a colour, 1 for the most road-like chroma
+    float probability(const int r, const int g, const int b) const
+    {
+        return rgbTable_[rgbIndex(r, g, b)];
+    }
+    // table behind probability(), indexed by rgbIndex()
+    const float* getRgbTable() const { return rgbTable_; }
+    static int rgbIndex(const int r, const int g, const int b)
+    {
+        return ((r >> (8 - RGB_BITS)) << (2 * RGB_BITS)) |
+               ((g >> (8 - RGB_BITS)) << RGB_BITS) |
+               (b >> (8 - RGB_BITS));
+    }
+
+    // RGB2CR and RGB2CB in 16.16 fixed point: Cr of (r, g, b) is
+    // (t[r] + t[256 + g] + t[512 + b]) >> 16, Cb uses t + 768
+    static const int* chromaTables();
+
+  private:
+    roadColorModel            (const roadColorModel &);
+    roadColorModel& operator= (const roadColorModel &);
+
+    void publish();
+
+    float forgetting_;
+    int step_;
+    int samples_;
+    //model has seen a frame since reset()
+    bool started_;
+    //decayed joint histogram, [cr][cb], sums to 1
+    float joint_[CHROMA_BINS * CHROMA_BINS];
+    //counts of current frame
+    int counts_[CHROMA_BINS * CHROMA_BINS];
+    //probability of every quantized colour, rebuilt by publish()
+    float rgbTable_[RGB_BINS * RGB_BINS * RGB_BINS];
+};
+
+#endif //NAVPRO_ROAD_COLOR_MODEL_H_
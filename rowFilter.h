@@ -0,0 +1,102 @@
+/*=============================================================================
+**                            MODULE SPECIFICATION
+===============================================================================
+**
+**  Title : Symmetric 1-D row filter
+**
+**  Description : Filters 8-bit rows with an odd, symmetric kernel whose
+**                width is a template parameter, so tap loops unroll. The
+**                kernel is folded: pixels at the same distance from the
+**                centre are added first and share one multiply.
+**
+**
+===============================================================================
+**  Author            :     Xin Zhang
+**  Creation Date     :     2013.06.18
+===============================================================================
+**/
+
+#ifndef NAVPRO_ROW_FILTER_H_
+#define NAVPRO_ROW_FILTER_H_
+
+#include <cmath>
+#include <QtGlobal>
+
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+
+template<int KERNEL_SIZE>
+class rowFilter
+{
+  public:
+    const static int RADIUS = KERNEL_SIZE / 2;
+
+    rowFilter()
+    {
+        for(int r = 0; r <= RADIUS; ++r)
+          folded_[r] = 0.0;
+    }
+
+    // kernel has KERNEL_SIZE taps, kernel[RADIUS] is the centre
+    void build(const float* kernel)
+    {
+        Q_ASSERT(KERNEL_SIZE % 2 == 1);
+        for(int r = 0; r <= RADIUS; ++r)
+        {
+            Q_ASSERT(fabs(kernel[RADIUS - r] - kernel[RADIUS + r]) <= 1e-6 * (fabs(kernel[RADIUS]) + 1.0));
+            folded_[r] = kernel[RADIUS + r];
+        }
+    }
+
+    // dst[x] for x in [RADIUS, width - RADIUS), truncated then saturated to
+    // [0, 255]. Columns closer to either end than RADIUS don't have every
+    // tap inside the row and are left as they are.
+    void apply(const uchar* src, uchar* dst, const int width) const
+    {
+        int x = RADIUS;
+        const int end = width - RADIUS;
+#ifdef __SSE2__
+        const __m128i zero = _mm_setzero_si128();
+        __m128i centre, pair, low, high;
+        __m128 sumLow, sumHigh, k;
+        for(; x + 8 <= end; x += 8)
+        {
+            //8 pixels per step, two float accumulators of 4
+            centre = _mm_unpacklo_epi8(_mm_loadl_epi64(reinterpret_cast<const __m128i*>(src + x)), zero);
+            k = _mm_set1_ps(folded_[0]);
+            sumLow = _mm_mul_ps(k, _mm_cvtepi32_ps(_mm_unpacklo_epi16(centre, zero)));
+            sumHigh = _mm_mul_ps(k, _mm_cvtepi32_ps(_mm_unpackhi_epi16(centre, zero)));
+            for(int r = 1; r <= RADIUS; ++r)
+            {
+                //a + b of two bytes fits 16 bits, exact like the scalar sum
+                low = _mm_unpacklo_epi8(_mm_loadl_epi64(reinterpret_cast<const __m128i*>(src + x - r)), zero);
+                high = _mm_unpacklo_epi8(_mm_loadl_epi64(reinterpret_cast<const __m128i*>(src + x + r)), zero);
+                pair = _mm_add_epi16(low, high);
+                k = _mm_set1_ps(folded_[r]);
+                sumLow = _mm_add_ps(sumLow, _mm_mul_ps(k, _mm_cvtepi32_ps(_mm_unpacklo_epi16(pair, zero))));
+                sumHigh = _mm_add_ps(sumHigh, _mm_mul_ps(k, _mm_cvtepi32_ps(_mm_unpackhi_epi16(pair, zero))));
+            }
+            //truncate, then saturate through int16 to uint8
+            low = _mm_packs_epi32(_mm_cvttps_epi32(sumLow), _mm_cvttps_epi32(sumHigh));
+            _mm_storel_epi64(reinterpret_cast<__m128i*>(dst + x), _mm_packus_epi16(low, low));
+        }
+#endif
+        float sum;
+        int value;
+        for(; x < end; ++x)
+        {
+            sum = folded_[0] * src[x];
+            for(int r = 1; r <= RADIUS; ++r)
+              sum += folded_[r] * (src[x - r] + src[x + r]);
+            value = static_cast<int>(sum);
+            dst[x] = static_cast<uchar>(qBound(0, value, 255));
+        }
+    }
+
+  private:
+    //folded_[r] is the tap r pixels from the centre
+    float folded_[RADIUS + 1];
+};
+
+#endif //NAVPRO_ROW_FILTER_H_
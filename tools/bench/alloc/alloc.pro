@@ -0,0 +1,49 @@
+TEMPLATE = app
+TARGET = alloc
+QT += core \
+    gui
+CONFIG += console
+CONFIG -= app_bundle
+
+#counts allocations of the tracking pipeline navpro runs, window aside
+NAVPRO_DIR = ../../..
+INCLUDEPATH += $$NAVPRO_DIR
+
+HEADERS += $$NAVPRO_DIR/eulerTransformer.h \
+           $$NAVPRO_DIR/frameSource.h \
+           $$NAVPRO_DIR/inputManager.h \
+           $$NAVPRO_DIR/laneModelFilter.h \
+           $$NAVPRO_DIR/laneTracker.h \
+           $$NAVPRO_DIR/navproCore.h \
+           $$NAVPRO_DIR/packedFrames.h \
+           $$NAVPRO_DIR/particleFilter.h \
+           $$NAVPRO_DIR/roadColorModel.h \
+           $$NAVPRO_DIR/rowFilter.h \
+           $$NAVPRO_DIR/videoFrame.h
+SOURCES += main.cpp \
+           $$NAVPRO_DIR/eulerTransformer.cpp \
+           $$NAVPRO_DIR/frameSource.cpp \
+           $$NAVPRO_DIR/inputManager.cpp \
+           $$NAVPRO_DIR/laneModelFilter.cpp \
+           $$NAVPRO_DIR/laneTracker.cpp \
+           $$NAVPRO_DIR/navproCore.cpp \
+           $$NAVPRO_DIR/packedFrames.cpp \
+           $$NAVPRO_DIR/particleFilter.cpp \
+           $$NAVPRO_DIR/roadColorModel.cpp
+
+CV_INCLUDEPATH = /usr/local/include/
+CV_LIBPATH = /usr/local/lib/
+
+INCLUDEPATH += $$CV_INCLUDEPATH
+
+LIBS += -L$$CV_LIBPATH -lopencv_core -lopencv_highgui -lopencv_imgproc
+
+QMAKE_LFLAGS += -Wl,-rpath,$$CV_LIBPATH
+
+#counts are those of the optimized build navpro ships
+CONFIG += release
+CONFIG -= debug
+
+CONFIG(release, debug|release) {
+     release: DEFINES += NDEBUG USER_NO_DEBUG _DISABLE_LOG_
+}
@@ -0,0 +1,254 @@
+/*=============================================================================
+**                            MODULE SPECIFICATION
+===============================================================================
+**
+**  Title : per-frame allocation counter
+**
+**  Description : Counts heap allocations of every frame navpro tracks.
+**                malloc, calloc, realloc and the aligned allocators are
+**                defined here and forward to glibc, so calls from Qt,
+**                OpenCV and libstdc++ (whose operator new allocates through
+**                malloc) are counted as well as navpro's own.
+**
+**                First pass runs the fused pipeline stage by stage with
+**                decoding and the filter on the calling thread and reports
+**                allocations per stage. Second pass runs navproCore
+**                headless, prefetch workers included, and reports the total
+**                per frame. The first WARMUP_FRAMES frames of each pass are
+**                not counted. glibc and Linux only. Usage:
+**
+**                  alloc [source] [--frames N]
+**
+**                Exits 1 when a steady state frame allocates in a stage
+**                that must not: preprocess, resample and predict, and
+**                frame for a mapped .pack source. Those are navpro's own
+**                buffers. Decoding JPEGs and videos, prefetch tasks and
+**                thread pool bookkeeping, and the scratch buffers OpenCV's
+**                Canny() and distanceTransform() allocate inside detect
+**                and update are out of scope, they are reported only.
+**
+**
+===============================================================================
+**  Author            :     Xin Zhang
+**  Creation Date     :     2013.06.27
+===============================================================================
+**/
+
+#include <cerrno>
+#include <cstddef>
+#include <cstdlib>
+#include <malloc.h>
+#include <iostream>
+#include <QApplication>
+#include <QStringList>
+
+#include "inputManager.h"
+#include "laneTracker.h"
+#include "navproCore.h"
+#include "particleFilter.h"
+#include "videoFrame.h"
+
+extern "C" {
+void* __libc_malloc(size_t size);
+void* __libc_calloc(size_t count, size_t size);
+void* __libc_realloc(void* p, size_t size);
+void* __libc_memalign(size_t alignment, size_t size);
+}
+
+//allocations counted so far from any thread, and whether to count
+static volatile long allocations = 0;
+static volatile bool counting = false;
+
+static inline void countAllocation()
+{
+    if (counting)
+      __sync_fetch_and_add(&allocations, 1);
+}
+
+extern "C" {
+void* malloc(size_t size) __THROW
+{
+    countAllocation();
+    return __libc_malloc(size);
+}
+
+void* calloc(size_t count, size_t size) __THROW
+{
+    countAllocation();
+    return __libc_calloc(count, size);
+}
+
+void* realloc(void* p, size_t size) __THROW
+{
+    countAllocation();
+    return __libc_realloc(p, size);
+}
+
+void* memalign(size_t alignment, size_t size) __THROW
+{
+    countAllocation();
+    return __libc_memalign(alignment, size);
+}
+
+int posix_memalign(void** p, size_t alignment, size_t size) __THROW
+{
+    countAllocation();
+    *p = __libc_memalign(alignment, size);
+    return *p ? 0 : ENOMEM;
+}
+}
+
+static const int WARMUP_FRAMES = 3;
+static const int DEFAULT_FRAMES = 50;
+
+//stages of the fused pipeline, in navproCore::probe() order
+enum {
+  FRAME = 0,
+  PREPROCESS,
+  DETECT,
+  UPDATE,
+  RESAMPLE,
+  PREDICT,
+  NUMBER_OF_STAGES
+};
+static const char* STAGE_NAMES[] = {"frame", "preprocess", "detect", "update",
+                                    "resample", "predict"};
+//stages whose steady state frames must not allocate, FRAME only when
+//frames are mapped
+static const bool CHECKED[] = {false, true, false, false, true, true};
+
+//allocations per frame of each stage, decode on the calling thread. False
+//when a checked stage allocated.
+static bool stagePass(QString& path, const int frames)
+{
+    laneTracker tracker;
+    inputManager input(path);
+    //no workers, their allocations would land in whatever stage runs.
+    //A video keeps one worker, which decodes while next() waits for it.
+    input.setPrefetch(1, 0);
+    particleFilter filter;
+    filter.enableAdaptive(200, particleFilter::NUMBER_OF_PARTICLES);
+    //pool bookkeeping isn't checked, corePass counts it
+    filter.setThreadCount(1);
+    videoFrame frame;
+    //packed frames are views into the mapping, see frameSource::open()
+    bool checked[NUMBER_OF_STAGES];
+    for (int s = 0; s < NUMBER_OF_STAGES; ++s)
+      checked[s] = CHECKED[s];
+    checked[FRAME] = path.endsWith(".pack");
+
+    long total[NUMBER_OF_STAGES] = {0};
+    long worst[NUMBER_OF_STAGES] = {0};
+    long count;
+    long start;
+    float speed, yawRate, interval;
+    int counted = 0;
+    for (int f = 0; f < frames; ++f)
+    {
+        counting = f >= WARMUP_FRAMES;
+        for (int s = 0; s < NUMBER_OF_STAGES; ++s)
+        {
+            start = allocations;
+            switch (s)
+            {
+              case FRAME:
+                input.getCurrentFrame(frame);
+              break;
+              case PREPROCESS:
+                tracker.preprocess(frame);
+              break;
+              case DETECT:
+                tracker.detect(laneTracker::EDGE_MASK | laneTracker::MARKER_RESPONSE |
+                               laneTracker::ROAD_COLOR_MODEL);
+              break;
+              case UPDATE:
+                filter.measurementUpdate(tracker.getEdgeMask(), tracker.getMarkerResponse(),
+                                         tracker.getColorModel(), frame.mat());
+              break;
+              case RESAMPLE:
+                filter.resample();
+              break;
+              case PREDICT:
+              default:
+                input.getEgoMotion(speed, yawRate);
+                interval = input.getFrameInterval();
+                filter.predict(speed, yawRate, interval);
+              break;
+            }
+            count = allocations - start;
+            total[s] += count;
+            worst[s] = qMax(worst[s], count);
+        }
+        if (counting)
+          ++counted;
+        if (!input.next())
+          break;
+    }
+    counting = false;
+
+    bool clean = true;
+    for (int s = 0; s < NUMBER_OF_STAGES; ++s)
+    {
+        std::cout<<STAGE_NAMES[s]<<" allocations per frame mean:"
+                 <<(counted ? static_cast<double>(total[s]) / counted : 0.0)
+                 <<" max:"<<worst[s]<<(checked[s] ? " checked" : "")<<std::endl;
+        if (checked[s] && worst[s] > 0)
+        {
+            std::cerr<<STAGE_NAMES[s]<<" allocates in steady state"<<std::endl;
+            clean = false;
+        }
+    }
+    return clean;
+}
+
+//allocations per navproCore::move(), prefetch workers included
+static void corePass(QString& path, const int frames)
+{
+    laneTracker tracker;
+    inputManager input(path);
+    navproCore core(&tracker, &input, navproCore::FUSED_FILTER, false);
+
+    long total = 0;
+    long worst = 0;
+    long start;
+    int counted = 0;
+    for (int f = 0; f < frames; ++f)
+    {
+        counting = f >= WARMUP_FRAMES;
+        start = allocations;
+        if (!core.move())
+          break;
+        if (counting)
+        {
+            total += allocations - start;
+            worst = qMax(worst, allocations - start);
+            ++counted;
+        }
+    }
+    counting = false;
+
+    std::cout<<"navproCore allocations per frame mean:"
+             <<(counted ? static_cast<double>(total) / counted : 0.0)
+             <<" max:"<<worst<<" frames:"<<counted<<std::endl;
+}
+
+int main(int argc, char *argv[])
+{
+    //navproCore is a widget even when it shows nothing
+    QApplication a(argc, argv);
+
+    const QStringList args = a.arguments();
+    QString path = QString("road/");
+    int frames = DEFAULT_FRAMES;
+    for (int i = 1; i < args.size(); ++i)
+    {
+        if (args[i] == "--frames" && i + 1 < args.size())
+          frames = qMax(WARMUP_FRAMES + 1, args[++i].toInt());
+        else if (!args[i].startsWith("--"))
+          path = args[i];
+    }
+
+    const bool clean = stagePass(path, frames);
+    corePass(path, frames);
+    return clean ? 0 : 1;
+}
@@ -0,0 +1,6 @@
+#benchmarks of navpro's hot paths, each one a console app
+TEMPLATE = subdirs
+SUBDIRS = resample \
+          measure \
+          rowfilter \
+          alloc
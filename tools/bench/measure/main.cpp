@@ -0,0 +1,190 @@
+/*=============================================================================
+**                            MODULE SPECIFICATION
+===============================================================================
+**
+**  Title : measurement update scaling benchmark
+**
+**  Description : Times particleFilter::measurementUpdate() at 1k, 10k and
+**                100k particles with 1 to N threads, on a synthetic road
+**                frame with two lane markers. Modes are the single cue
+**                update by exhaustive search and by distance transform, and
+**                the fused edge, marker and colour update navpro runs.
+**                Particles are diffused between rounds, untimed. Usage:
+**
+**                  measure [exhaustive|distance|fused ...] [--threads N]
+**                          [--rounds R]
+**
+**                N defaults to QThread::idealThreadCount(), every mode
+**                runs when none is named. Blocks on the pool must give the
+**                serial weights bit for bit, every run with more than one
+**                thread is checked against the single thread run and the
+**                benchmark exits 1 when one differs. --threads above the
+**                core count still checks the split on a small machine.
+**
+**
+===============================================================================
+**  Author            :     Xin Zhang
+**  Creation Date     :     2013.06.27
+===============================================================================
+**/
+
+#include <iostream>
+#include <vector>
+#include <QCoreApplication>
+#include <QElapsedTimer>
+#include <QStringList>
+#include <QThread>
+#include <opencv2/core/core.hpp>
+
+#include "environment.h"
+#include "particleFilter.h"
+#include "roadColorModel.h"
+
+static const int PARTICLE_COUNTS[] = {1000, 10000, 100000};
+static const int DEFAULT_ROUNDS = 20;
+
+enum {
+  EXHAUSTIVE = 0,
+  DISTANCE,
+  FUSED,
+  NUMBER_OF_MODES
+};
+static const char* MODE_NAMES[] = {"exhaustive", "distance", "fused"};
+
+//synthetic frame: gray road in the lower half, a white marker stroke
+//either side, and masks of those strokes for the edge and marker cues
+struct scene
+{
+  cv::Mat bgr;
+  cv::Mat edges;
+  cv::Mat markers;
+  roadColorModel model;
+
+  scene()
+    : bgr(FRAME_HEIGHT, FRAME_WIDTH, CV_8UC3, cv::Scalar(40, 90, 60)),
+      edges(FRAME_HEIGHT, FRAME_WIDTH, CV_8UC1, cv::Scalar::all(0)),
+      markers(FRAME_HEIGHT, FRAME_WIDTH, CV_8UC1, cv::Scalar::all(0))
+  {
+    const cv::Rect road = ROAD_RECT(FRAME_WIDTH, FRAME_HEIGHT);
+    bgr(road) = cv::Scalar::all(110);
+    int left, right;
+    for (int y = road.y; y < road.y + road.height; ++y)
+    {
+      //markers converge towards the horizon
+      left = FRAME_WIDTH / 2 - (y - road.y) * 3 / 4 - 20;
+      right = FRAME_WIDTH / 2 + (y - road.y) * 3 / 4 + 20;
+      for (int x = left - 3; x <= left + 3; ++x)
+      {
+        if (x < 0)
+          continue;
+        bgr.at<cv::Vec3b>(y, x) = cv::Vec3b(255, 255, 255);
+        markers.at<uchar>(y, x) = 255;
+      }
+      for (int x = right - 3; x <= right + 3; ++x)
+      {
+        if (x >= FRAME_WIDTH)
+          continue;
+        bgr.at<cv::Vec3b>(y, x) = cv::Vec3b(255, 255, 255);
+        markers.at<uchar>(y, x) = 255;
+      }
+      if (left - 4 >= 0)
+        edges.at<uchar>(y, left - 4) = 255;
+      if (right + 4 < FRAME_WIDTH)
+        edges.at<uchar>(y, right + 4) = 255;
+    }
+    model.update(bgr, road);
+  }
+};
+
+//mean ms of one update of mode with count particles on threads threads,
+//weights of the last round into weights
+static double run(const int mode, const int count, const int threads, const int rounds,
+                  const scene& frame, std::vector<float>& weights)
+{
+    particleFilter filter(count);
+    filter.setThreadCount(threads);
+    filter.setMeasureMode(mode == EXHAUSTIVE ? particleFilter::EXHAUSTIVE_SEARCH :
+                                               particleFilter::DISTANCE_TRANSFORM);
+
+    QElapsedTimer timer;
+    qint64 total = 0;
+    for (int r = 0; r < rounds; ++r)
+    {
+        timer.start();
+        if (mode == FUSED)
+          filter.measurementUpdate(frame.edges, frame.markers, frame.model, frame.bgr);
+        else
+          filter.measurementUpdate(frame.edges);
+        total += timer.nsecsElapsed();
+        if (r + 1 < rounds)
+          filter.diffuse(8.0, 8.0);
+    }
+
+    //same seed and per-chunk streams, so every split sees the same particles
+    const particleSet* set = filter.getParticles();
+    weights.assign(set->weight, set->weight + filter.getParticleCount());
+    return total / 1000000.0 / rounds;
+}
+
+int main(int argc, char *argv[])
+{
+    QCoreApplication a(argc, argv);
+
+    const QStringList args = a.arguments();
+    int maxThreads = QThread::idealThreadCount();
+    int rounds = DEFAULT_ROUNDS;
+    bool modes[NUMBER_OF_MODES] = {false, false, false};
+    bool named = false;
+    for (int i = 1; i < args.size(); ++i)
+    {
+        if (args[i] == "--threads" && i + 1 < args.size())
+          maxThreads = qMax(1, args[++i].toInt());
+        else if (args[i] == "--rounds" && i + 1 < args.size())
+          rounds = qMax(1, args[++i].toInt());
+        else
+        {
+            for (int m = 0; m < NUMBER_OF_MODES; ++m)
+            {
+                if (args[i] == MODE_NAMES[m])
+                {
+                    modes[m] = true;
+                    named = true;
+                }
+            }
+        }
+    }
+
+    scene frame;
+    double serial;
+    double ms;
+    std::vector<float> serialWeights;
+    std::vector<float> weights;
+    bool match;
+    bool allMatch = true;
+    for (int m = 0; m < NUMBER_OF_MODES; ++m)
+    {
+        if (named && !modes[m])
+          continue;
+        for (size_t c = 0; c < sizeof(PARTICLE_COUNTS) / sizeof(PARTICLE_COUNTS[0]); ++c)
+        {
+            serial = 0.0;
+            for (int threads = 1; threads <= maxThreads; ++threads)
+            {
+                ms = run(m, PARTICLE_COUNTS[c], threads, rounds, frame,
+                         threads == 1 ? serialWeights : weights);
+                if (threads == 1)
+                  serial = ms;
+                match = threads == 1 || weights == serialWeights;
+                allMatch = allMatch && match;
+                std::cout<<MODE_NAMES[m]<<" particles:"<<PARTICLE_COUNTS[c]
+                         <<" threads:"<<threads
+                         <<" ms mean:"<<ms
+                         <<" speedup:"<<serial / ms
+                         <<" weights:"<<(match ? "serial" : "DIFFER")<<std::endl;
+            }
+        }
+    }
+    if (!allMatch)
+      std::cerr<<"parallel weights differ from serial ones"<<std::endl;
+    return allMatch ? 0 : 1;
+}
@@ -0,0 +1,35 @@
+TEMPLATE = app
+TARGET = measure
+QT += core \
+    gui
+CONFIG += console
+CONFIG -= app_bundle
+
+#benchmark links the filter exactly as navpro builds it
+NAVPRO_DIR = ../../..
+INCLUDEPATH += $$NAVPRO_DIR
+
+HEADERS += $$NAVPRO_DIR/eulerTransformer.h \
+           $$NAVPRO_DIR/particleFilter.h \
+           $$NAVPRO_DIR/roadColorModel.h
+SOURCES += main.cpp \
+           $$NAVPRO_DIR/eulerTransformer.cpp \
+           $$NAVPRO_DIR/particleFilter.cpp \
+           $$NAVPRO_DIR/roadColorModel.cpp
+
+CV_INCLUDEPATH = /usr/local/include/
+CV_LIBPATH = /usr/local/lib/
+
+INCLUDEPATH += $$CV_INCLUDEPATH
+
+LIBS += -L$$CV_LIBPATH -lopencv_core -lopencv_imgproc
+
+QMAKE_LFLAGS += -Wl,-rpath,$$CV_LIBPATH
+
+#timings only mean something optimized
+CONFIG += release
+CONFIG -= debug
+
+CONFIG(release, debug|release) {
+     release: DEFINES += NDEBUG USER_NO_DEBUG _DISABLE_LOG_
+}
@@ -0,0 +1,97 @@
+/*=============================================================================
+**                            MODULE SPECIFICATION
+===============================================================================
+**
+**  Title : resample benchmark
+**
+**  Description : Times particleFilter::resample() with every resampler at
+**                1k, 10k and 100k particles, and KLD-sampling capped at the
+**                same counts. Each round first runs an exhaustive
+**                measurement update against a synthetic lane stroke, so
+**                weights are peaked as on the road, and diffuses particles
+**                after, so the set doesn't collapse. Only resample() is
+**                timed. Usage:
+**
+**                  resample [rounds]
+**
+**
+===============================================================================
+**  Author            :     Xin Zhang
+**  Creation Date     :     2013.06.27
+===============================================================================
+**/
+
+#include <iostream>
+#include <QCoreApplication>
+#include <QElapsedTimer>
+#include <QStringList>
+#include <opencv2/core/core.hpp>
+
+#include "environment.h"
+#include "particleFilter.h"
+
+static const int PARTICLE_COUNTS[] = {1000, 10000, 100000};
+static const int DEFAULT_ROUNDS = 50;
+//RESAMPLE_* methods, then KLD-sampling
+static const int KLD = particleFilter::RESAMPLE_STRATIFIED + 1;
+static const char* METHOD_NAMES[] = {"wheel", "systematic", "stratified", "kld"};
+
+//time resample() of one method at one particle count
+static void run(const int method, const int count, const int rounds, const cv::Mat& mask)
+{
+    particleFilter filter(count);
+    filter.setMeasureMode(particleFilter::EXHAUSTIVE_SEARCH);
+    if (method == KLD)
+      filter.enableAdaptive(qMin(count, particleFilter::MIN_BLOCK_SIZE), count);
+    else
+      filter.setResampleMethod(method);
+    //every call resamples, whatever ESS the update left
+    filter.setResampleThreshold(2.0);
+
+    QElapsedTimer timer;
+    qint64 total = 0;
+    qint64 worst = 0;
+    qint64 elapsed;
+    //KLD-sampling changes the count every round
+    qint64 drawn = 0;
+    for (int r = 0; r < rounds; ++r)
+    {
+        filter.measurementUpdate(mask);
+        timer.start();
+        filter.resample();
+        elapsed = timer.nsecsElapsed();
+        total += elapsed;
+        worst = qMax(worst, elapsed);
+        drawn += filter.getParticleCount();
+        filter.diffuse(8.0, 8.0);
+    }
+
+    std::cout<<METHOD_NAMES[method]<<" particles:"<<count
+             <<" drawn mean:"<<drawn / rounds
+             <<" us mean:"<<total / 1000.0 / rounds
+             <<" max:"<<worst / 1000.0
+             <<" ns/particle:"<<static_cast<double>(total) / drawn<<std::endl;
+}
+
+int main(int argc, char *argv[])
+{
+    QCoreApplication a(argc, argv);
+
+    int rounds = DEFAULT_ROUNDS;
+    if (a.arguments().size() > 1)
+      rounds = qMax(1, a.arguments()[1].toInt());
+
+    //one slanted marker stroke in the road half, few feature pixels keep
+    //the untimed exhaustive update cheap next to 100k particles
+    cv::Mat mask(FRAME_HEIGHT, FRAME_WIDTH, CV_8UC1, cv::Scalar::all(0));
+    const int top = FRAME_HEIGHT * 3 / 4;
+    for (int y = top; y < top + 32; ++y)
+      mask.at<uchar>(y, FRAME_WIDTH / 3 + (y - top) / 2) = 255;
+
+    for (size_t c = 0; c < sizeof(PARTICLE_COUNTS) / sizeof(PARTICLE_COUNTS[0]); ++c)
+    {
+        for (int method = particleFilter::RESAMPLE_WHEEL; method <= KLD; ++method)
+          run(method, PARTICLE_COUNTS[c], rounds, mask);
+    }
+    return 0;
+}
@@ -0,0 +1,131 @@
+/*=============================================================================
+**                            MODULE SPECIFICATION
+===============================================================================
+**
+**  Title : lane marker row filter benchmark
+**
+**  Description : Times the 11 tap LoG lane marker filter over the road half
+**                of a FRAME_WIDTH x FRAME_HEIGHT gray frame three ways: the
+**                per-pixel loop laneMarkerDetect() used to run, rowFilter,
+**                and cv::sepFilter2D with a 1 tap column kernel.
+**                sepFilter2D also fills the border columns, so it does a
+**                little more work than the other two. Usage:
+**
+**                  rowfilter [rounds]
+**
+**
+===============================================================================
+**  Author            :     Xin Zhang
+**  Creation Date     :     2013.06.27
+===============================================================================
+**/
+
+#include <iostream>
+#include <QCoreApplication>
+#include <QElapsedTimer>
+#include <QStringList>
+#include <opencv2/core/core.hpp>
+#include <opencv2/imgproc/imgproc.hpp>
+
+#include "environment.h"
+#include "rowFilter.h"
+
+static const int KERNEL_SIZE = 11;
+static const int DEFAULT_ROUNDS = 200;
+
+//the loop laneMarkerDetect() ran before rowFilter, one multiply per tap
+//and the float sum truncated straight into the byte. That loop ran to
+//width - KERNEL_SIZE/2 and read KERNEL_SIZE/2 bytes past the row; this
+//one stops where the last tap is the last pixel, so it writes the same
+//columns rowFilter does.
+static void oldMarkerRow(const uchar* src, uchar* dst, const int width, const float* k)
+{
+    float sum_f;
+    const uchar* src_pos_in_row;
+    for(int x = 0; x < width - KERNEL_SIZE + 1; ++x)
+    {
+        sum_f = 0.0;
+        src_pos_in_row = src + x;
+        for (int kx = 0; kx < KERNEL_SIZE; ++kx)
+        {
+            sum_f += *(src_pos_in_row++) * k[kx];
+        }
+        *(dst + x + KERNEL_SIZE/2) = static_cast<int>(sum_f);
+    }
+}
+
+//one line per implementation: mean us per road half, ns per pixel and
+//speedup over the old loop
+static void report(const char* name, const qint64 total, const int rounds,
+                   const cv::Mat& src, const double baseline)
+{
+    const double us = total / 1000.0 / rounds;
+    std::cout<<name<<" us mean:"<<us
+             <<" ns/pixel:"<<us * 1000.0 / (src.rows * src.cols)
+             <<" speedup:"<<(baseline > 0.0 ? baseline / us : 1.0)<<std::endl;
+}
+
+int main(int argc, char *argv[])
+{
+    QCoreApplication a(argc, argv);
+
+    int rounds = DEFAULT_ROUNDS;
+    if (a.arguments().size() > 1)
+      rounds = qMax(1, a.arguments()[1].toInt());
+
+    float k[KERNEL_SIZE];
+    for (int i = 0, j = -(KERNEL_SIZE/2); i < KERNEL_SIZE; ++i, ++j)
+      k[i] = LoG(j);
+    rowFilter<KERNEL_SIZE> filter;
+    filter.build(k);
+
+    //road half with pseudo random texture, content doesn't change the
+    //cost of any of the three
+    const cv::Rect road = ROAD_RECT(FRAME_WIDTH, FRAME_HEIGHT);
+    cv::Mat src(road.height, road.width, CV_8UC1);
+    quint32 state = 1;
+    for (int y = 0; y < src.rows; ++y)
+    {
+        for (int x = 0; x < src.cols; ++x)
+        {
+            state = state * 1664525u + 1013904223u;
+            src.at<uchar>(y, x) = static_cast<uchar>(state >> 24);
+        }
+    }
+    cv::Mat dst(src.rows, src.cols, CV_8UC1, cv::Scalar::all(0));
+
+    QElapsedTimer timer;
+    qint64 total = 0;
+    for (int r = 0; r < rounds; ++r)
+    {
+        timer.start();
+        for (int y = 0; y < src.rows; ++y)
+          oldMarkerRow(src.ptr(y), dst.ptr(y), src.cols, k);
+        total += timer.nsecsElapsed();
+    }
+    const double baseline = total / 1000.0 / rounds;
+    report("old loop", total, rounds, src, 0.0);
+
+    total = 0;
+    for (int r = 0; r < rounds; ++r)
+    {
+        timer.start();
+        for (int y = 0; y < src.rows; ++y)
+          filter.apply(src.ptr(y), dst.ptr(y), src.cols);
+        total += timer.nsecsElapsed();
+    }
+    report("rowFilter", total, rounds, src, baseline);
+
+    //same taps, saturating 8-bit output, border columns filled too
+    const cv::Mat kernelX(1, KERNEL_SIZE, CV_32FC1, k);
+    const cv::Mat kernelY(1, 1, CV_32FC1, cv::Scalar::all(1.0));
+    total = 0;
+    for (int r = 0; r < rounds; ++r)
+    {
+        timer.start();
+        cv::sepFilter2D(src, dst, CV_8U, kernelX, kernelY);
+        total += timer.nsecsElapsed();
+    }
+    report("sepFilter2D", total, rounds, src, baseline);
+    return 0;
+}
@@ -0,0 +1,30 @@
+TEMPLATE = app
+TARGET = rowfilter
+QT += core
+QT -= gui
+CONFIG += console
+CONFIG -= app_bundle
+
+#benchmark uses the row filter header exactly as laneTracker does
+NAVPRO_DIR = ../../..
+INCLUDEPATH += $$NAVPRO_DIR
+
+HEADERS += $$NAVPRO_DIR/rowFilter.h
+SOURCES += main.cpp
+
+CV_INCLUDEPATH = /usr/local/include/
+CV_LIBPATH = /usr/local/lib/
+
+INCLUDEPATH += $$CV_INCLUDEPATH
+
+LIBS += -L$$CV_LIBPATH -lopencv_core -lopencv_imgproc
+
+QMAKE_LFLAGS += -Wl,-rpath,$$CV_LIBPATH
+
+#timings only mean something optimized
+CONFIG += release
+CONFIG -= debug
+
+CONFIG(release, debug|release) {
+     release: DEFINES += NDEBUG USER_NO_DEBUG _DISABLE_LOG_
+}
@@ -0,0 +1,125 @@
+/*=============================================================================
+**                            MODULE SPECIFICATION
+===============================================================================
+**
+**  Title : packframes
+**
+**  Description : Converts any frame source navpro reads (a road/ directory
+**                of JPEGs, a video, a raw dump) into a packed container of
+**                FRAME_WIDTH x FRAME_HEIGHT BGR or gray frames, see
+**                packedFrames.h. Usage:
+**
+**                  packframes <source> <out.pack> [--gray]
+**
+**
+===============================================================================
+**  Author            :     Xin Zhang
+**  Creation Date     :     2013.06.26
+===============================================================================
+**/
+
+#include <iostream>
+#include <QCoreApplication>
+#include <QFile>
+#include <QFileInfo>
+#include <QStringList>
+#include <opencv2/imgproc/imgproc.hpp>
+
+#include "inputManager.h"
+#include "packedFrames.h"
+#include "videoFrame.h"
+
+int main(int argc, char *argv[])
+{
+    //image plugins need an application object
+    QCoreApplication a(argc, argv);
+
+    QStringList args = a.arguments();
+    const bool gray = args.contains("--gray");
+    args.removeAll("--gray");
+    if (args.size() != 3)
+    {
+        std::cerr<<"usage: packframes <source> <out.pack> [--gray]"<<std::endl;
+        return 1;
+    }
+    QString sourcePath = args[1];
+    const QString outPath = args[2];
+
+    inputManager input(sourcePath);
+    packedFrameWriter writer;
+    if (!writer.open(outPath, FRAME_WIDTH, FRAME_HEIGHT, gray ? 1 : 3))
+      return 1;
+
+    videoFrame frame;
+    cv::Mat packed;
+    QString path;
+    double timestamp = 0.0;
+    do
+    {
+        if (input.getCurrentFrame(frame) && !frame.isNull())
+        {
+            //decoded frames arrive RGB32 at working size, i.e. BGRA.
+            //Frames of a .pack input are views of BGR or gray at its size.
+            cv::Mat in = frame.mat();
+            cv::Mat resized;
+            if (in.cols != FRAME_WIDTH || in.rows != FRAME_HEIGHT)
+            {
+                cv::resize(in, resized, cv::Size(FRAME_WIDTH, FRAME_HEIGHT));
+                in = resized;
+            }
+            if (in.channels() == 4)
+              cv::cvtColor(in, packed, gray ? CV_BGRA2GRAY : CV_BGRA2BGR);
+            else if (in.channels() == 3)
+            {
+                if (gray)
+                  cv::cvtColor(in, packed, CV_BGR2GRAY);
+                else
+                  in.copyTo(packed);
+            }
+            else
+            {
+                if (gray)
+                  in.copyTo(packed);
+                else
+                  cv::cvtColor(in, packed, CV_GRAY2BGR);
+            }
+            input.getCurrentImagePath(path);
+            //a shortened name would miss its ego-motion entry
+            const QString name = QFileInfo(path).fileName();
+            if (!packedFrameWriter::nameFits(name))
+            {
+                std::cerr<<"frame name too long for a packed entry ("
+                         <<PACKED_NAME_SIZE - 1<<" bytes max): "
+                         <<name.toAscii().data()<<std::endl;
+                return 1;
+            }
+            if (!writer.append(packed, name, timestamp))
+            {
+                std::cerr<<"write failed"<<std::endl;
+                return 1;
+            }
+        }
+        else
+        {
+            std::cerr<<"skipping unreadable frame"<<std::endl;
+        }
+        timestamp += input.getFrameInterval();
+    } while (input.next());
+
+    const int frames = writer.getFrameCount();
+    if (!writer.close())
+    {
+        std::cerr<<"write failed"<<std::endl;
+        return 1;
+    }
+    std::cout<<"packed "<<frames<<" frames into "<<outPath.toAscii().data()<<std::endl;
+
+    //ego-motion log is keyed by frame name, keep it beside the container
+    QFileInfo source(sourcePath);
+    const QString log = (source.isDir() ? sourcePath + '/' : source.absolutePath() + '/') +
+                        EGO_MOTION_FILE;
+    const QString packedLog = QFileInfo(outPath).absolutePath() + '/' + EGO_MOTION_FILE;
+    if (QFile::exists(log) && !QFile::exists(packedLog))
+      QFile::copy(log, packedLog);
+    return 0;
+}
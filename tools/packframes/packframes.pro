@@ -0,0 +1,32 @@
+TEMPLATE = app
+TARGET = packframes
+QT += core \
+    gui
+CONFIG += console
+CONFIG -= app_bundle
+
+#converter shares frame reading and container writing with navpro
+NAVPRO_DIR = ../..
+INCLUDEPATH += $$NAVPRO_DIR
+
+HEADERS += $$NAVPRO_DIR/frameSource.h \
+           $$NAVPRO_DIR/inputManager.h \
+           $$NAVPRO_DIR/packedFrames.h \
+           $$NAVPRO_DIR/videoFrame.h
+SOURCES += main.cpp \
+           $$NAVPRO_DIR/frameSource.cpp \
+           $$NAVPRO_DIR/inputManager.cpp \
+           $$NAVPRO_DIR/packedFrames.cpp
+
+CV_INCLUDEPATH = /usr/local/include/
+CV_LIBPATH = /usr/local/lib/
+
+INCLUDEPATH += $$CV_INCLUDEPATH
+
+LIBS += -L$$CV_LIBPATH -lopencv_core -lopencv_highgui -lopencv_imgproc
+
+QMAKE_LFLAGS += -Wl,-rpath,$$CV_LIBPATH
+
+CONFIG(release, debug|release) {
+     release: DEFINES += NDEBUG USER_NO_DEBUG _DISABLE_LOG_
+}
@@ -0,0 +1,100 @@
+/*=============================================================================
+**                            MODULE SPECIFICATION
+===============================================================================
+**
+**  Title : re-seed check
+**
+**  Description : Pushes every particle off the frame, so predict()
+**                re-seeds all of them, then runs a measurement update
+**                against a lane stroke and a resample. Re-seeded particles
+**                must carry weight: the update must find support instead
+**                of resetting, and the resampled set must gather on the
+**                stroke. Exits 0 on success, 1 on failure.
+**
+**
+===============================================================================
+**  Author            :     Xin Zhang
+**  Creation Date     :     2013.06.28
+===============================================================================
+**/
+
+#include <cmath>
+#include <iostream>
+#include <QCoreApplication>
+#include <opencv2/core/core.hpp>
+
+#include "environment.h"
+#include "particleFilter.h"
+
+static const int PARTICLES = 1000;
+//particles this close to the stroke count as on it
+static const float NEAR_STROKE = 20.0;
+
+static int fail(const char* what)
+{
+    std::cerr<<"reseed FAILED: "<<what<<std::endl;
+    return 1;
+}
+
+//share of particles within NEAR_STROKE of the vertical stroke at column
+static float nearShare(const particleFilter& filter, const int column)
+{
+    const particleSet* set = filter.getParticles();
+    int near = 0;
+    for (int k = 0; k < filter.getParticleCount(); ++k)
+    {
+        if (fabs(set->x[k] - column) < NEAR_STROKE)
+          ++near;
+    }
+    return static_cast<float>(near) / filter.getParticleCount();
+}
+
+int main(int argc, char *argv[])
+{
+    QCoreApplication a(argc, argv);
+
+    //one vertical stroke in the road half
+    const int column = FRAME_WIDTH / 3;
+    cv::Mat mask(FRAME_HEIGHT, FRAME_WIDTH, CV_8UC1, cv::Scalar::all(0));
+    for (int y = FRAME_HEIGHT / 2; y < FRAME_HEIGHT; ++y)
+      mask.at<uchar>(y, column) = 255;
+
+    particleFilter filter(PARTICLES);
+    filter.setMeasureMode(particleFilter::EXHAUSTIVE_SEARCH);
+    filter.setProcessNoise(0.0, 0.0);
+    filter.setResampleThreshold(2.0);
+
+    //below the frame and no motion, predict() leaves them there and so
+    //re-seeds every one
+    filter.move(2 * FRAME_HEIGHT);
+    filter.predict(0.0, 0.0, 0.0);
+
+    const particleSet* set = filter.getParticles();
+    float total = 0.0;
+    for (int k = 0; k < filter.getParticleCount(); ++k)
+    {
+        if (set->x[k] < 0 || set->x[k] > FRAME_WIDTH ||
+            set->y[k] < 0 || set->y[k] > FRAME_HEIGHT)
+          return fail("particle left off the frame");
+        if (set->weight[k] <= 0.0)
+          return fail("re-seeded particle has no weight");
+        total += set->weight[k];
+    }
+    if (fabs(total - 1.0) > 1e-3)
+      return fail("weights don't sum to 1 after predict");
+
+    const float before = nearShare(filter, column);
+    filter.measurementUpdate(mask);
+    if (filter.getHealth().reset)
+      return fail("update found no support, weights were reset");
+    filter.resample();
+    if (!filter.getHealth().resampled)
+      return fail("resample didn't run");
+    const float after = nearShare(filter, column);
+    if (after <= before)
+      return fail("resampled set didn't gather on the stroke");
+
+    std::cout<<"reseed passed, near stroke before:"<<before
+             <<" after:"<<after<<std::endl;
+    return 0;
+}
@@ -0,0 +1,4 @@
+#checks of navpro's filters, each one a console app that exits non-zero
+#when it fails
+TEMPLATE = subdirs
+SUBDIRS = reseed
@@ -0,0 +1,90 @@
+/*=============================================================================
+**                            MODULE SPECIFICATION
+===============================================================================
+**
+**  Title : Video frame
+**
+**  Description : One decoded frame at working resolution, shared between
+**                display and processing. Pixels are held by a RGB32 QImage
+**                and viewed in place as a CV_8UC4 Mat in BGRA byte order,
+**                so neither side copies or decodes again. A frame can also
+**                be a BGR or gray Mat view, e.g. into a mapped container;
+**                its QImage is then made only when asked for.
+**
+**
+===============================================================================
+**  Author            :     Xin Zhang
+**  Creation Date     :     2013.06.24
+===============================================================================
+**/
+
+#ifndef NAVPRO_VIDEO_FRAME_H_
+#define NAVPRO_VIDEO_FRAME_H_
+
+#include <QImage>
+#include <opencv2/core/core.hpp>
+#include <opencv2/imgproc/imgproc.hpp>
+
+#include "environment.h"
+
+class videoFrame
+{
+  public:
+    videoFrame()
+    {
+    }
+
+    // share image's pixels, converted once when it isn't RGB32
+    explicit videoFrame(const QImage& image)
+    {
+        setImage(image);
+    }
+
+    void setImage(const QImage& image)
+    {
+        image_ = image;
+        if (!image_.isNull() && image_.format() != QImage::Format_RGB32 &&
+            image_.format() != QImage::Format_ARGB32)
+          image_ = image_.convertToFormat(QImage::Format_RGB32);
+        if (image_.isNull())
+        {
+            mat_ = cv::Mat();
+            return;
+        }
+        //QRgb 0xAARRGGBB is B, G, R, A in memory on little endian hosts.
+        //constBits() doesn't detach, the view is read only.
+        mat_ = cv::Mat(image_.height(), image_.width(), CV_8UC4,
+                       const_cast<uchar*>(image_.constBits()), image_.bytesPerLine());
+    }
+
+    // CV_8UC3 BGR or CV_8UC1 gray, pixels stay owned by whoever owns mat
+    void setMat(const cv::Mat& mat)
+    {
+        Q_ASSERT(mat.empty() || mat.type() == CV_8UC3 || mat.type() == CV_8UC1);
+        mat_ = mat;
+        image_ = QImage();
+    }
+
+    bool isNull() const { return mat_.empty(); }
+    const QImage& image() const
+    {
+        if (image_.isNull() && !mat_.empty())
+        {
+            //Mat frame, converted once on first use
+            image_ = QImage(mat_.cols, mat_.rows, QImage::Format_RGB32);
+            cv::Mat view(image_.height(), image_.width(), CV_8UC4,
+                         image_.bits(), image_.bytesPerLine());
+            cv::cvtColor(mat_, view, mat_.channels() == 1 ? CV_GRAY2BGRA : CV_BGR2BGRA);
+        }
+        return image_;
+    }
+    // CV_8UC4 BGRA for QImage frames, as given to setMat() otherwise.
+    // Valid while this frame, or a copy of image(), holds the pixels.
+    const cv::Mat& mat() const { return mat_; }
+
+  private:
+    mutable QImage image_;
+    cv::Mat mat_;
+};
+
+#endif //NAVPRO_VIDEO_FRAME_H_